@@ -0,0 +1,106 @@
+#include "./benchmarking/coherence_benchmark.h"
+#include "./benchmarking/timer.h"
+
+#include "./core/cpu_features.h"
+
+#include "./core/graphics/screen/surface.h"
+#include "./core/math/trigonometry.h"
+#include "./raytracing/camera.h"
+#include "./raytracing/raytracer.h"
+#include "./raytracing/scene.h"
+#include "./scene/scene_loading.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <iostream>
+
+namespace CRT
+{
+	namespace
+	{
+		constexpr uint32_t Width = 640;
+		constexpr uint32_t Height = 360;
+		constexpr uint32_t Samples = 2;
+		// Best of a few renders, the first one also warms up the caches and the threads
+		constexpr uint32_t Repetitions = 2;
+
+		float Render(Scene& _scene, int _threadCount, EThreadAffinity _affinity)
+		{
+			const float2 resolution = float2(float(Width), float(Height));
+			Camera camera(resolution);
+			camera.SetPosition(float3(0.0f, 2.0f, 3.0f));
+			camera.SetDirection(float3(0.0f, -0.4f, -1.0f).Normalize());
+			camera.SetFieldOfView(ToRadians(90.0f));
+			camera.SetAntiAliasing(Samples);
+
+			Surface surface(Width, Height);
+			Raytracer raytracer(surface, _scene, camera, _threadCount, _affinity);
+			raytracer.SetAdaptiveSampling(false);
+
+			Timer timer;
+			do
+			{
+				raytracer.RenderFrame();
+			} while (!raytracer.IsConverged());
+			return timer.GetDuration().count();
+		}
+	}
+
+	void CoherenceBenchmark::Run(int _threadCount, EThreadAffinity _affinity)
+	{
+		struct Configuration
+		{
+			const char* Name;
+			bool RaySorting;
+			ETraversalMode TraversalMode;
+			// Lowered to what the CPU supports
+			EInstructionSet InstructionSet;
+		};
+		constexpr Configuration Configurations[] = {
+			{ "pixel order", false, ETraversalMode::SingleRay, EInstructionSet::AVX512 },
+			{ "sorted", true, ETraversalMode::SingleRay, EInstructionSet::AVX512 },
+			{ "interleaved", false, ETraversalMode::Interleaved, EInstructionSet::AVX512 },
+			{ "sorted and interleaved", true, ETraversalMode::Interleaved, EInstructionSet::AVX512 },
+			{ "treelets", false, ETraversalMode::Treelets, EInstructionSet::AVX512 },
+			{ "sorted treelets", true, ETraversalMode::Treelets, EInstructionSet::AVX512 },
+			{ "packets of 8", false, ETraversalMode::Packets, EInstructionSet::AVX2 },
+			{ "packets of 16", false, ETraversalMode::Packets, EInstructionSet::AVX512 }
+		};
+		constexpr uint32_t ConfigurationCount = uint32_t(sizeof(Configurations) / sizeof(Configurations[0]));
+
+		const EInstructionSet instructionSet = CpuFeatures::GetInstructionSet();
+		std::cout << "Rendering " << Width << "x" << Height << " with " << Samples << " samples per pixel on "
+			<< _threadCount << " threads, best of " << Repetitions << "\n";
+		for (const char* scenePath : { "builtin-mirrors", "builtin-glass" })
+		{
+			Scene scene;
+			SceneLoading::BuildScene(&scene, scenePath);
+
+			float durations[ConfigurationCount];
+			std::fill(std::begin(durations), std::end(durations), FLT_MAX);
+			for (uint32_t repetition = 0; repetition < Repetitions; repetition++)
+			{
+				for (uint32_t i = 0; i < ConfigurationCount; i++)
+				{
+					scene.SetRaySorting(Configurations[i].RaySorting);
+					scene.SetTraversalMode(Configurations[i].TraversalMode);
+					CpuFeatures::SetInstructionSet(Configurations[i].InstructionSet);
+					durations[i] = std::min(durations[i], Render(scene, _threadCount, _affinity));
+				}
+			}
+
+			std::cout << scenePath << ", " << scene.GetTriangleCount() << " triangles:\n";
+			for (uint32_t i = 0; i < ConfigurationCount; i++)
+			{
+				std::cout << "  " << Configurations[i].Name << ": " << durations[i] << " s, speedup "
+					<< durations[0] / durations[i] << "\n";
+			}
+		}
+		CpuFeatures::SetInstructionSet(instructionSet);
+		if (CpuFeatures::GetSupportedInstructionSet() < EInstructionSet::AVX512)
+		{
+			std::cout << "The CPU doesn't support AVX-512, the packets of 16 are " << (CpuFeatures::GetSupportedInstructionSet()
+				< EInstructionSet::AVX2 ? "traced one ray at a time like the packets of 8\n" : "packets of 8\n");
+		}
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "./core/job_manager.h"
+
+namespace CRT
+{
+	// Renders the mirror and the glass spheres with the secondary rays traced in pixel order or sorted by
+	// direction and origin, with each of the traversals and both packet widths, and prints how long each took
+	class CoherenceBenchmark
+	{
+	public:
+		static void Run(int _threadCount, EThreadAffinity _affinity);
+	};
+}
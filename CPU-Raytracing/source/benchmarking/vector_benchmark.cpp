@@ -0,0 +1,104 @@
+#include "./benchmarking/vector_benchmark.h"
+#include "./benchmarking/timer.h"
+
+#include "./core/math/float3.h"
+#include "./core/random_generator.h"
+#include "./raytracing/aabb.h"
+#include "./raytracing/manifest.h"
+#include "./raytracing/ray.h"
+#include "./raytracing/shapes/triangle.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <iostream>
+#include <vector>
+
+namespace CRT
+{
+	namespace
+	{
+		// Small enough for the caches, so the time goes to the math and not to memory
+		constexpr uint32_t Count = 4096;
+		constexpr uint32_t Passes = 500;
+		constexpr uint32_t Repetitions = 3;
+
+#if !defined(CRT_SIMD_VECTORS)
+		static_assert(float3(1.0f, 2.0f, 3.0f).Cross(float3::XAxis()).Dot(float3::One()) == 1.0f,
+			"the vector math is evaluated at compile time without the SSE backing");
+#endif
+
+		// Best of a few runs, in nanoseconds per element. The result of every element is summed up, so none of
+		// the work can be left out
+		template<typename TKernel>
+		void Time(const char* _name, TKernel _kernel)
+		{
+			float best = FLT_MAX;
+			float sum = 0.0f;
+			for (uint32_t repetition = 0; repetition < Repetitions; repetition++)
+			{
+				Timer timer;
+				for (uint32_t pass = 0; pass < Passes; pass++)
+				{
+					for (uint32_t i = 0; i < Count; i++)
+					{
+						sum += _kernel(i);
+					}
+				}
+				best = std::min(best, timer.GetDuration().count());
+			}
+			std::cout << "  " << _name << ": " << best * 1e9f / float(Passes * Count) << " ns (" << sum << ")\n";
+		}
+	}
+
+	void VectorBenchmark::Run()
+	{
+		RandomGenerator generator(1);
+		const auto next = [&generator]()
+		{
+			return float3(generator.NextFloat(), generator.NextFloat(), generator.NextFloat()) * 2.0f - 1.0f;
+		};
+
+		std::vector<Ray> rays;
+		std::vector<AABB> boxes;
+		std::vector<Triangle> triangles;
+		std::vector<float3> vectors;
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			rays.emplace_back(next() * 4.0f, next().Normalize());
+			const float3 center = next();
+			boxes.push_back({ center - 0.5f, center + 0.5f });
+			triangles.emplace_back(center + next(), center + next(), center + next(), float2(0.0f), float2(0.0f),
+				float2(0.0f), next(), next(), next());
+			vectors.push_back(next());
+		}
+
+		std::cout << "Vector math over " << Count << " elements, best of " << Repetitions << "\n";
+		Time("slab test", [&](uint32_t _i)
+		{
+			return boxes[_i].Intersects(rays[_i]) ? 1.0f : 0.0f;
+		});
+		Time("triangle test", [&](uint32_t _i)
+		{
+			Manifest manifest;
+			return triangles[_i].Intersect(rays[_i], manifest) ? manifest.T : 0.0f;
+		});
+		Time("triangle bounds", [&](uint32_t _i)
+		{
+			const Triangle& triangle = triangles[_i];
+			return (float3::ComponentMax({ triangle.V0, triangle.V1, triangle.V2 })
+				- float3::ComponentMin({ triangle.V0, triangle.V1, triangle.V2 })).x;
+		});
+		Time("cross, normalize and dot", [&](uint32_t _i)
+		{
+			const float3& a = vectors[_i];
+			const float3& b = vectors[(_i + 1) % Count];
+			return a.Cross(b).Normalize().Dot(rays[_i].D);
+		});
+		Time("reflection", [&](uint32_t _i)
+		{
+			const float3& d = rays[_i].D;
+			const float3 n = vectors[_i].Normalize();
+			return (d - 2.0f * d.Dot(n) * n).y;
+		});
+	}
+}
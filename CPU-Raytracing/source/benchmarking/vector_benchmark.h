@@ -0,0 +1,12 @@
+#pragma once
+
+namespace CRT
+{
+	// Times the float3 math of the inner loops, slab and triangle tests and the vector operations of shading,
+	// over a working set that fits the caches, and prints the time per operation
+	class VectorBenchmark
+	{
+	public:
+		static void Run();
+	};
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdlib>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+namespace CRT
+{
+	// _aligned_malloc only exists on Windows, while MSVC doesn't provide aligned_alloc
+	inline void* AlignedMalloc(size_t _size, size_t _alignment)
+	{
+#if defined(_MSC_VER)
+		return _aligned_malloc(_size, _alignment);
+#else
+		// aligned_alloc requires the size to be a multiple of the alignment
+		return std::aligned_alloc(_alignment, (_size + _alignment - 1) / _alignment * _alignment);
+#endif
+	}
+
+	inline void AlignedFree(void* _memory)
+	{
+#if defined(_MSC_VER)
+		_aligned_free(_memory);
+#else
+		std::free(_memory);
+#endif
+	}
+}
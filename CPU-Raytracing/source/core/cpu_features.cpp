@@ -0,0 +1,117 @@
+#include "./core/cpu_features.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+
+namespace CRT
+{
+	namespace
+	{
+		struct CpuidResult
+		{
+			uint32_t Eax;
+			uint32_t Ebx;
+			uint32_t Ecx;
+			uint32_t Edx;
+		};
+
+		CpuidResult Cpuid(uint32_t _leaf, uint32_t _subleaf)
+		{
+			CpuidResult result{};
+#if defined(_MSC_VER)
+			int registers[4];
+			__cpuidex(registers, int(_leaf), int(_subleaf));
+			result = { uint32_t(registers[0]), uint32_t(registers[1]), uint32_t(registers[2]), uint32_t(registers[3]) };
+#else
+			__get_cpuid_count(_leaf, _subleaf, &result.Eax, &result.Ebx, &result.Ecx, &result.Edx);
+#endif
+			return result;
+		}
+
+		// Which register states the operating system saves on a context switch
+		uint64_t GetEnabledStates()
+		{
+#if defined(_MSC_VER)
+			return _xgetbv(0);
+#else
+			uint32_t low, high;
+			__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+			return (uint64_t(high) << 32) | low;
+#endif
+		}
+
+		bool HasBit(uint32_t _register, uint32_t _bit)
+		{
+			return (_register >> _bit) & 1u;
+		}
+
+		EInstructionSet QueryInstructionSet()
+		{
+			const CpuidResult features = Cpuid(1, 0);
+			// Without OSXSAVE there's no way to tell whether the AVX registers survive a context switch
+			if (!HasBit(features.Ecx, 27) || !HasBit(features.Ecx, 28) || !HasBit(features.Ecx, 12)
+				|| Cpuid(0, 0).Eax < 7)
+			{
+				return EInstructionSet::SSE4;
+			}
+			const uint64_t states = GetEnabledStates();
+			const CpuidResult extendedFeatures = Cpuid(7, 0);
+			// The SSE and AVX states
+			if ((states & 0x6) != 0x6 || !HasBit(extendedFeatures.Ebx, 5))
+			{
+				return EInstructionSet::SSE4;
+			}
+			// AVX-512 F, DQ and VL, and the opmask and upper ZMM states
+			if (HasBit(extendedFeatures.Ebx, 16) && HasBit(extendedFeatures.Ebx, 17) && HasBit(extendedFeatures.Ebx, 31)
+				&& (states & 0xe0) == 0xe0)
+			{
+				return EInstructionSet::AVX512;
+			}
+			return EInstructionSet::AVX2;
+		}
+
+		std::atomic<EInstructionSet>& GetForcedInstructionSet()
+		{
+			static std::atomic<EInstructionSet> instructionSet(CpuFeatures::GetSupportedInstructionSet());
+			return instructionSet;
+		}
+	}
+
+	EInstructionSet CpuFeatures::GetSupportedInstructionSet()
+	{
+		static const EInstructionSet instructionSet = QueryInstructionSet();
+		return instructionSet;
+	}
+
+	EInstructionSet CpuFeatures::GetInstructionSet()
+	{
+		return GetForcedInstructionSet().load(std::memory_order_relaxed);
+	}
+
+	EInstructionSet CpuFeatures::SetInstructionSet(EInstructionSet _instructionSet)
+	{
+		const EInstructionSet instructionSet = std::min(_instructionSet, GetSupportedInstructionSet());
+		GetForcedInstructionSet().store(instructionSet, std::memory_order_relaxed);
+		return instructionSet;
+	}
+
+	const char* CpuFeatures::GetName(EInstructionSet _instructionSet)
+	{
+		switch (_instructionSet)
+		{
+		case EInstructionSet::AVX2:
+			return "AVX2";
+		case EInstructionSet::AVX512:
+			return "AVX-512";
+		default:
+			return "SSE4";
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+
+// Kernels for a higher instruction set than the project is built for are compiled for it with these, and only
+// called once CpuFeatures says the CPU has it. MSVC compiles any intrinsic without them
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CRT_TARGET_AVX2
+#define CRT_TARGET_AVX512
+#else
+#define CRT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define CRT_TARGET_AVX512 __attribute__((target("avx2,fma,avx512f,avx512dq,avx512vl")))
+#endif
+
+namespace CRT
+{
+	enum class EInstructionSet
+	{
+		/* The baseline the project is built for, every kernel has a version for it */
+		SSE4,
+		/* Eight floats per vector and fused multiply-add */
+		AVX2,
+		/* Sixteen floats per vector and mask registers */
+		AVX512
+	};
+
+	// Picks the instruction set the kernels run with, from what the CPU and the operating system support.
+	// Queried once, so one binary runs on older machines as well as it can on newer ones
+	class CpuFeatures
+	{
+	public:
+		static EInstructionSet GetSupportedInstructionSet();
+		static EInstructionSet GetInstructionSet();
+		// Forces a lower instruction set, e.g. to compare the kernels. Higher ones than the CPU supports are
+		// clamped, returns the one that is used
+		static EInstructionSet SetInstructionSet(EInstructionSet _instructionSet);
+		static const char* GetName(EInstructionSet _instructionSet);
+	};
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+namespace CRT
+{
+	// Lets a thread wait until a fixed amount of participants arrived, e.g. until all workers
+	// finished their part of a frame. Reusable by resetting it once everyone arrived
+	class FrameBarrier
+	{
+	public:
+		void Reset(uint32_t _participantCount)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Remaining = _participantCount;
+		}
+
+		void Arrive()
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (--m_Remaining == 0)
+			{
+				m_AllArrived.notify_all();
+			}
+		}
+
+		void Wait()
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_AllArrived.wait(lock, [this] { return m_Remaining == 0; });
+		}
+
+	private:
+		std::mutex m_Mutex;
+		std::condition_variable m_AllArrived;
+		uint32_t m_Remaining = 0;
+	};
+}
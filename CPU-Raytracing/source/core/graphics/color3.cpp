@@ -9,4 +9,9 @@ namespace CRT
 	const color3 Color::Green = float3(0.0f, 1.0f, 0.0f);
 	const color3 Color::Yellow = float3(1.0f, 1.0f, 0.0f);
 	const color3 Color::Purple = float3(1.0f, 0.0f, 1.0f);
+
+	float GetLuminance(const color3& _color)
+	{
+		return 0.2126f * _color.x + 0.7152f * _color.y + 0.0722f * _color.z;
+	}
 }
\ No newline at end of file
@@ -16,4 +16,7 @@ namespace CRT
 		const static color3 Yellow;
 		const static color3 Purple;
 	};
+
+	// Relative luminance of a linear color (Rec. 709)
+	float GetLuminance(const color3& _color);
 }
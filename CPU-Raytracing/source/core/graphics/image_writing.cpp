@@ -0,0 +1,271 @@
+#include "./core/graphics/image_writing.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace CRT
+{
+	namespace
+	{
+		void AppendBigEndian(std::vector<uint8_t>& _buffer, uint32_t _value)
+		{
+			_buffer.push_back(uint8_t(_value >> 24));
+			_buffer.push_back(uint8_t(_value >> 16));
+			_buffer.push_back(uint8_t(_value >> 8));
+			_buffer.push_back(uint8_t(_value));
+		}
+
+		template<typename T>
+		void AppendLittleEndian(std::vector<uint8_t>& _buffer, T _value)
+		{
+			uint8_t bytes[sizeof(T)];
+			std::memcpy(bytes, &_value, sizeof(T));
+			// Only little endian targets are supported anyway
+			_buffer.insert(_buffer.end(), bytes, bytes + sizeof(T));
+		}
+
+		void AppendString(std::vector<uint8_t>& _buffer, const char* _string)
+		{
+			_buffer.insert(_buffer.end(), _string, _string + std::strlen(_string) + 1);
+		}
+
+		uint32_t Crc32(const uint8_t* _data, size_t _size)
+		{
+			static const std::array<uint32_t, 256> table = []
+			{
+				std::array<uint32_t, 256> result;
+				for (uint32_t i = 0; i < 256; i++)
+				{
+					uint32_t c = i;
+					for (int bit = 0; bit < 8; bit++)
+					{
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					}
+					result[i] = c;
+				}
+				return result;
+			}();
+
+			uint32_t crc = 0xFFFFFFFFu;
+			for (size_t i = 0; i < _size; i++)
+			{
+				crc = table[(crc ^ _data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return crc ^ 0xFFFFFFFFu;
+		}
+
+		uint32_t Adler32(const uint8_t* _data, size_t _size)
+		{
+			uint32_t a = 1;
+			uint32_t b = 0;
+			for (size_t i = 0; i < _size; i++)
+			{
+				a = (a + _data[i]) % 65521;
+				b = (b + a) % 65521;
+			}
+			return (b << 16) | a;
+		}
+
+		void AppendPNGChunk(std::vector<uint8_t>& _file, const char* _type, const std::vector<uint8_t>& _data)
+		{
+			AppendBigEndian(_file, uint32_t(_data.size()));
+			const size_t typeStart = _file.size();
+			_file.insert(_file.end(), _type, _type + 4);
+			_file.insert(_file.end(), _data.begin(), _data.end());
+			AppendBigEndian(_file, Crc32(&_file[typeStart], _file.size() - typeStart));
+		}
+
+		bool WriteFile(const std::string& _filepath, const std::vector<uint8_t>& _data)
+		{
+			std::ofstream file(_filepath, std::ios::binary);
+			if (!file)
+			{
+				std::cout << "Could not open " << _filepath << " for writing\n";
+				return false;
+			}
+			file.write(reinterpret_cast<const char*>(_data.data()), _data.size());
+			return bool(file);
+		}
+
+		std::string GetExtension(const std::string& _filepath)
+		{
+			const size_t dot = _filepath.find_last_of('.');
+			if (dot == std::string::npos)
+			{
+				return "";
+			}
+			std::string extension = _filepath.substr(dot + 1);
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](char _c) { return char(std::tolower(_c)); });
+			return extension;
+		}
+	}
+
+	bool ImageWriting::WriteImage(const std::string& _filepath, const Surface& _surface, const std::vector<float3>& _image)
+	{
+		const std::string extension = GetExtension(_filepath);
+		if (extension == "png")
+		{
+			return WritePNG(_filepath, _surface);
+		}
+		if (extension == "ppm")
+		{
+			return WritePPM(_filepath, _surface);
+		}
+		if (extension == "exr")
+		{
+			return WriteEXR(_filepath, _image, _surface.GetWidth(), _surface.GetHeight());
+		}
+		std::cout << "Unsupported image format: " << _filepath << "\n";
+		return false;
+	}
+
+	bool ImageWriting::WritePPM(const std::string& _filepath, const Surface& _surface)
+	{
+		const std::string header = "P6\n" + std::to_string(_surface.GetWidth()) + " " + std::to_string(_surface.GetHeight()) + "\n255\n";
+		std::vector<uint8_t> file(header.begin(), header.end());
+		file.reserve(file.size() + (size_t)_surface.GetWidth() * _surface.GetHeight() * 3);
+		for (uint64_t i = 0; i < (uint64_t)_surface.GetWidth() * _surface.GetHeight(); i++)
+		{
+			const Pixel pixel = _surface.GetBuffer()[i];
+			file.push_back(uint8_t(pixel >> 16));
+			file.push_back(uint8_t(pixel >> 8));
+			file.push_back(uint8_t(pixel));
+		}
+		return WriteFile(_filepath, file);
+	}
+
+	bool ImageWriting::WritePNG(const std::string& _filepath, const Surface& _surface)
+	{
+		const uint32_t width = _surface.GetWidth();
+		const uint32_t height = _surface.GetHeight();
+
+		// Every row starts with its filter type, none
+		std::vector<uint8_t> scanlines;
+		scanlines.reserve((size_t)(width * 3 + 1) * height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			scanlines.push_back(0);
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const Pixel pixel = _surface.GetBuffer()[x + (uint64_t)y * width];
+				scanlines.push_back(uint8_t(pixel >> 16));
+				scanlines.push_back(uint8_t(pixel >> 8));
+				scanlines.push_back(uint8_t(pixel));
+			}
+		}
+
+		// zlib stream made of stored deflate blocks, which hold at most 65535 bytes each
+		const size_t MaxBlockSize = 65535;
+		std::vector<uint8_t> compressed = { 0x78, 0x01 };
+		compressed.reserve(scanlines.size() + scanlines.size() / MaxBlockSize * 5 + 16);
+		for (size_t offset = 0; offset < scanlines.size(); offset += MaxBlockSize)
+		{
+			const uint16_t size = uint16_t(std::min(MaxBlockSize, scanlines.size() - offset));
+			compressed.push_back(offset + size == scanlines.size() ? 1 : 0);
+			AppendLittleEndian(compressed, size);
+			AppendLittleEndian(compressed, uint16_t(~size));
+			compressed.insert(compressed.end(), scanlines.begin() + offset, scanlines.begin() + offset + size);
+		}
+		AppendBigEndian(compressed, Adler32(scanlines.data(), scanlines.size()));
+
+		std::vector<uint8_t> header;
+		AppendBigEndian(header, width);
+		AppendBigEndian(header, height);
+		// 8 bits per channel, RGB, default compression, filtering and no interlacing
+		header.insert(header.end(), { 8, 2, 0, 0, 0 });
+
+		std::vector<uint8_t> file = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		AppendPNGChunk(file, "IHDR", header);
+		AppendPNGChunk(file, "IDAT", compressed);
+		AppendPNGChunk(file, "IEND", {});
+		return WriteFile(_filepath, file);
+	}
+
+	bool ImageWriting::WriteEXR(const std::string& _filepath, const std::vector<float3>& _image, uint32_t _width, uint32_t _height)
+	{
+		if (_image.size() != (size_t)_width * _height)
+		{
+			std::cout << "Image size doesn't match " << _width << "x" << _height << "\n";
+			return false;
+		}
+
+		std::vector<uint8_t> file;
+		AppendLittleEndian(file, uint32_t(20000630));
+		// Version 2, single part scanline file
+		AppendLittleEndian(file, uint32_t(2));
+
+		// Channels have to be sorted by name
+		const char* channels[] = { "B", "G", "R" };
+		std::vector<uint8_t> channelList;
+		for (const char* channel : channels)
+		{
+			AppendString(channelList, channel);
+			// 32 bit float, not linear, reserved and a sampling of 1 in both directions
+			AppendLittleEndian(channelList, int32_t(2));
+			channelList.insert(channelList.end(), { 0, 0, 0, 0 });
+			AppendLittleEndian(channelList, int32_t(1));
+			AppendLittleEndian(channelList, int32_t(1));
+		}
+		channelList.push_back(0);
+
+		const auto appendAttribute = [&file](const char* _name, const char* _type, const std::vector<uint8_t>& _value)
+		{
+			AppendString(file, _name);
+			AppendString(file, _type);
+			AppendLittleEndian(file, int32_t(_value.size()));
+			file.insert(file.end(), _value.begin(), _value.end());
+		};
+		std::vector<uint8_t> window;
+		AppendLittleEndian(window, int32_t(0));
+		AppendLittleEndian(window, int32_t(0));
+		AppendLittleEndian(window, int32_t(_width - 1));
+		AppendLittleEndian(window, int32_t(_height - 1));
+		std::vector<uint8_t> one;
+		AppendLittleEndian(one, 1.0f);
+		std::vector<uint8_t> center;
+		AppendLittleEndian(center, 0.0f);
+		AppendLittleEndian(center, 0.0f);
+
+		appendAttribute("channels", "chlist", channelList);
+		appendAttribute("compression", "compression", { 0 });
+		appendAttribute("dataWindow", "box2i", window);
+		appendAttribute("displayWindow", "box2i", window);
+		appendAttribute("lineOrder", "lineOrder", { 0 });
+		appendAttribute("pixelAspectRatio", "float", one);
+		appendAttribute("screenWindowCenter", "v2f", center);
+		appendAttribute("screenWindowWidth", "float", one);
+		file.push_back(0);
+
+		// Offset table, followed by one block per scanline holding its y, its size and then each channel's row
+		const uint32_t lineSize = _width * 3 * sizeof(float);
+		const uint64_t firstLine = file.size() + (uint64_t)_height * sizeof(uint64_t);
+		for (uint32_t y = 0; y < _height; y++)
+		{
+			AppendLittleEndian(file, uint64_t(firstLine + (uint64_t)y * (lineSize + 8)));
+		}
+		file.reserve(firstLine + (uint64_t)_height * (lineSize + 8));
+		for (uint32_t y = 0; y < _height; y++)
+		{
+			AppendLittleEndian(file, int32_t(y));
+			AppendLittleEndian(file, int32_t(lineSize));
+			const float3* row = &_image[(uint64_t)y * _width];
+			for (uint32_t x = 0; x < _width; x++)
+			{
+				AppendLittleEndian(file, row[x].z);
+			}
+			for (uint32_t x = 0; x < _width; x++)
+			{
+				AppendLittleEndian(file, row[x].y);
+			}
+			for (uint32_t x = 0; x < _width; x++)
+			{
+				AppendLittleEndian(file, row[x].x);
+			}
+		}
+		return WriteFile(_filepath, file);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "./core/graphics/screen/surface.h"
+#include "./core/math/float3.h"
+
+#include <string>
+#include <vector>
+
+namespace CRT
+{
+	// Writes rendered images to disk without any third party dependency
+	class ImageWriting
+	{
+	public:
+		// Picks the format from the extension of the path, .png, .ppm or .exr. The EXR gets the unclamped
+		// image, the other formats the surface
+		static bool WriteImage(const std::string& _filepath, const Surface& _surface, const std::vector<float3>& _image);
+
+		static bool WritePPM(const std::string& _filepath, const Surface& _surface);
+		// Uncompressed deflate blocks, large files but no zlib needed
+		static bool WritePNG(const std::string& _filepath, const Surface& _surface);
+		// Uncompressed scanlines of 32 bit float RGB
+		static bool WriteEXR(const std::string& _filepath, const std::vector<float3>& _image, uint32_t _width, uint32_t _height);
+	};
+}
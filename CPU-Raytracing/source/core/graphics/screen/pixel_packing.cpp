@@ -0,0 +1,64 @@
+#include "./core/graphics/screen/pixel_packing.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+
+namespace CRT
+{
+#if !defined(CRT_SIMD_VECTORS)
+	// The SIMD path reads the colors as a flat float array
+	static_assert(sizeof(float3) == 3 * sizeof(float), "float3 has to be tightly packed");
+#endif
+
+	void PackPixels(const float3* _colors, Pixel* _destination, uint32_t _count)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 scale = _mm_set1_ps(255.0f);
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+		uint32_t i = 0;
+		for (; i + 4 <= _count; i += 4)
+		{
+#if defined(CRT_SIMD_VECTORS)
+			// Every color is a register of its own, the fourth lanes end up in the unused one
+			__m128 r = _colors[i].m;
+			__m128 g = _colors[i + 1].m;
+			__m128 bl = _colors[i + 2].m;
+			__m128 unused = _colors[i + 3].m;
+			_MM_TRANSPOSE4_PS(r, g, bl, unused);
+#else
+			// Four colors are three registers of interleaved xyz, transpose them to rrrr, gggg, bbbb
+			const float* source = &_colors[i].x;
+			__m128 a = _mm_loadu_ps(source);
+			__m128 b = _mm_loadu_ps(source + 4);
+			__m128 c = _mm_loadu_ps(source + 8);
+
+			__m128 r = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+			__m128 g = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+				_mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 bl = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+#endif
+
+			// Truncate like the scalar conversion does
+			__m128i ri = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(r, zero), one), scale));
+			__m128i gi = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(g, zero), one), scale));
+			__m128i bi = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(bl, zero), one), scale));
+
+			__m128i packed = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(ri, 16)),
+				_mm_or_si128(_mm_slli_epi32(gi, 8), bi));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(_destination + i), packed);
+		}
+
+		for (; i < _count; i++)
+		{
+			_destination[i] = PackPixel(_colors[i]);
+		}
+	}
+
+	Pixel PackPixel(const float3& _color)
+	{
+		float3 color = _color.ComponentMax(float3::Zero()).ComponentMin(float3::One());
+		return 0xff000000 | (int(color.x * 255) << 16) | (int(color.y * 255) << 8) | int(color.z * 255);
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "./core/graphics/screen/pixel.h"
+#include "./core/math/float3.h"
+
+namespace CRT
+{
+	// Clamps linear colors to [0, 1] and packs them into 0xAARRGGBB pixels, four at a time
+	void PackPixels(const float3* _colors, Pixel* _destination, uint32_t _count);
+
+	Pixel PackPixel(const float3& _color);
+}
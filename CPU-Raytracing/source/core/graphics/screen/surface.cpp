@@ -1,4 +1,5 @@
 #include "./core/graphics/screen/surface.h"
+#include "./core/aligned_memory.h"
 
 #include <stdlib.h>
 
@@ -9,7 +10,7 @@ namespace CRT
 		, m_Height(_height)
 	{
 		// Allign buffer to 64
-		m_Buffer = (Pixel*)_aligned_malloc(m_Width * m_Height * sizeof(Pixel), 64);
+		m_Buffer = (Pixel*)AlignedMalloc(m_Width * m_Height * sizeof(Pixel), 64);
 	}
 
 	Surface::Surface(const uint32_t _width, const uint32_t _height, Pixel* _buffer)
@@ -20,7 +21,7 @@ namespace CRT
 
 	Surface::~Surface()
 	{
-		_aligned_free(m_Buffer);
+		AlignedFree(m_Buffer);
 	}
 
 	void Surface::Set(const uint32_t _x, const uint32_t _y, const Pixel _p)
@@ -1,10 +1,16 @@
 #pragma once
 #include "./raytracing/ray.h"
+#include "./core/work_stealing_queue.h"
+#include "./core/numa_topology.h"
 
-#include <concurrent_queue.h>
 #include <thread>
 #include <future>
-#include <queue>
+#include <functional>
+#include <atomic>
+#include <random>
+#include <condition_variable>
+#include <optional>
+#include <algorithm>
 
 namespace CRT
 {
@@ -12,6 +18,18 @@ namespace CRT
 
 	struct EmptyThreadState {};
 
+	enum class EThreadAffinity
+	{
+		// Workers run wherever the scheduler puts them
+		None,
+		// Every worker is pinned to its own CPU, with the workers spread over the NUMA nodes
+		NUMANode
+	};
+
+	// Thread pool with a work stealing queue per worker. Jobs added from a worker (nested jobs) go to
+	// that worker's own queue, jobs added from any other thread are distributed over the workers.
+	// Idle workers steal from a random other worker before going to sleep, preferring workers on their own
+	// NUMA node when the workers are pinned
 	template<typename TThreadStateType = EmptyThreadState>
 	class JobManager
 	{
@@ -21,12 +39,13 @@ namespace CRT
 		using ThreadInitType = std::function<TThreadStateType(void)>;
 
 		// -1 means use threads equal to the amount of hardware threads
-		explicit JobManager(ThreadInitType _threadInit = [] { return EmptyThreadState{}; }, int _numThreads = -1);
+		explicit JobManager(ThreadInitType _threadInit = [] { return EmptyThreadState{}; }, int _numThreads = -1,
+			EThreadAffinity _affinity = EThreadAffinity::None);
 
 		~JobManager()
 		{
 			{
-				std::unique_lock<std::mutex> lock(m_TaskQueueMutex);
+				std::unique_lock<std::mutex> lock(m_SleepMutex);
 				m_Done = true;
 			}
 			m_JobReady.notify_all();
@@ -41,22 +60,59 @@ namespace CRT
 			auto task = std::make_shared<std::packaged_task<return_type(ArgType&)>>(job);
 
 			std::future<return_type> future = task->get_future();
+			// don't allow enqueueing after stopping the pool
+			if (m_Done)
+				throw std::runtime_error("enqueue on stopped ThreadPool");
+
+			Push([task](ArgType& threadState)
 			{
-				std::unique_lock<std::mutex> lock(m_TaskQueueMutex);
+				(*task)(threadState);
+			});
+			return future;
+		}
 
-				// don't allow enqueueing after stopping the pool
-				if (m_Done)
-					throw std::runtime_error("enqueue on stopped ThreadPool");
+		// Queues a copy of the job on every worker, without the future and task allocations of AddJob.
+		// Meant for long running jobs that pull their work from elsewhere, e.g. an atomic counter
+		void Broadcast(const JobType& _job)
+		{
+			if (m_Done)
+				throw std::runtime_error("enqueue on stopped ThreadPool");
+
+			for (uint32_t i = 0; i < uint32_t(m_Queues.size()); i++)
+			{
+				m_PendingJobs.fetch_add(1);
+				m_Queues[i].Push(_job);
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_SleepMutex);
+			}
+			m_JobReady.notify_all();
+		}
 
-				m_TaskQueue.emplace([task](ArgType& threadState)
+		// Waits for the result of a job. When called from one of our workers, e.g. for a job
+		// waiting on its nested jobs, the worker keeps executing other jobs while it waits
+		template<typename TReturnType>
+		TReturnType WaitFor(std::future<TReturnType>& _future)
+		{
+			if (s_Worker != nullptr && s_Worker->Owner == this)
+			{
+				while (_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
 				{
-					(*task)(threadState);
-				});
+					JobType job;
+					if (TryGetJob(*s_Worker, job))
+					{
+						job(*s_Worker->ThreadState);
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
 			}
-			m_JobReady.notify_one();
-			return future;
+			return _future.get();
 		}
-		unsigned GetMaxWorkerThreads()
+
+		static unsigned GetMaxWorkerThreads()
 		{
 			auto maxThreads = std::thread::hardware_concurrency();
 			if (maxThreads < 2u)
@@ -65,47 +121,197 @@ namespace CRT
 
 			return std::max(1u, maxThreads - 2);
 		}
+
+		uint32_t GetWorkerCount() const
+		{
+			return uint32_t(m_WorkerThreads.size());
+		}
+
+		// Nodes the workers are spread over, always 1 without NUMA affinity
+		uint32_t GetNodeCount() const
+		{
+			return m_NodeCount;
+		}
+
+		uint32_t GetNodeWorkerCount(uint32_t _node) const
+		{
+			return uint32_t(std::count(m_WorkerNodes.begin(), m_WorkerNodes.end(), _node));
+		}
+
+		// Node of the worker calling this, 0 for any other thread
+		uint32_t GetCurrentNode() const
+		{
+			return s_Worker != nullptr && s_Worker->Owner == this ? m_WorkerNodes[s_Worker->Index] : 0;
+		}
 	private:
-		std::vector<std::thread> InitThreads(const std::function<TThreadStateType()>& _threadInit, uint32_t _numThreads)
+		struct WorkerContext
+		{
+			JobManager* Owner = nullptr;
+			uint32_t Index = 0;
+			TThreadStateType* ThreadState = nullptr;
+			std::minstd_rand VictimGenerator;
+		};
+
+		void Push(JobType _job)
 		{
+			// Count before pushing, so that a worker never sleeps while a job is in a queue
+			m_PendingJobs.fetch_add(1);
+			if (s_Worker != nullptr && s_Worker->Owner == this)
+			{
+				m_Queues[s_Worker->Index].Push(std::move(_job));
+			}
+			else
+			{
+				m_Queues[m_NextQueue.fetch_add(1, std::memory_order_relaxed) % m_Queues.size()].Push(std::move(_job));
+			}
+
+			if (m_SleepingWorkers.load() > 0)
+			{
+				// Lock so the notify can't slip in between a worker checking for jobs and going to sleep
+				{
+					std::lock_guard<std::mutex> lock(m_SleepMutex);
+				}
+				m_JobReady.notify_one();
+			}
+		}
+
+		bool TryGetJob(WorkerContext& _worker, JobType& _job)
+		{
+			if (m_Queues[_worker.Index].Pop(_job))
+			{
+				m_PendingJobs.fetch_sub(1);
+				return true;
+			}
+
+			// Start at a random victim so thieves spread out instead of all hammering the same worker. Jobs of
+			// the own node come first, their data is more likely to be in local memory and the shared cache
+			const uint32_t queueCount = uint32_t(m_Queues.size());
+			const uint32_t start = uint32_t(_worker.VictimGenerator() % queueCount);
+			const uint32_t node = m_WorkerNodes[_worker.Index];
+			for (uint32_t pass = 0; pass < (m_NodeCount > 1 ? 2u : 1u); pass++)
+			{
+				for (uint32_t i = 0; i < queueCount; i++)
+				{
+					uint32_t victim = (start + i) % queueCount;
+					if (m_NodeCount > 1 && (m_WorkerNodes[victim] == node) != (pass == 0))
+					{
+						continue;
+					}
+					if (victim != _worker.Index && m_Queues[victim].Steal(_job))
+					{
+						m_PendingJobs.fetch_sub(1);
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		// Splits the workers over the nodes in proportion to their CPUs, returning the CPU of every worker
+		std::vector<uint32_t> AssignNodes(uint32_t _numThreads, EThreadAffinity _affinity)
+		{
+			m_WorkerNodes.assign(_numThreads, 0);
+			if (_affinity == EThreadAffinity::None)
+			{
+				return {};
+			}
+
+			const std::vector<NumaNode>& nodes = NumaTopology::GetNodes();
+			uint32_t cpuCount = 0;
+			for (const NumaNode& node : nodes)
+			{
+				cpuCount += uint32_t(node.CPUs.size());
+			}
+
+			std::vector<uint32_t> cpus(_numThreads);
+			uint32_t worker = 0;
+			uint32_t cpusBefore = 0;
+			for (uint32_t node = 0; node < uint32_t(nodes.size()); node++)
+			{
+				cpusBefore += uint32_t(nodes[node].CPUs.size());
+				const uint32_t workerEnd = uint32_t((uint64_t)_numThreads * cpusBefore / cpuCount);
+				for (uint32_t local = 0; worker < workerEnd; worker++, local++)
+				{
+					m_WorkerNodes[worker] = node;
+					cpus[worker] = nodes[node].CPUs[local % nodes[node].CPUs.size()];
+				}
+			}
+			m_NodeCount = uint32_t(nodes.size());
+			return cpus;
+		}
+
+		std::vector<std::thread> InitThreads(const std::function<TThreadStateType()>& _threadInit, uint32_t _numThreads,
+			EThreadAffinity _affinity)
+		{
+			const std::vector<uint32_t> cpus = AssignNodes(_numThreads, _affinity);
 			std::vector<std::thread> threads;
 			threads.reserve(_numThreads);
-			for (size_t i = 0; i < _numThreads; i++)
+			for (uint32_t i = 0; i < _numThreads; i++)
 			{
-				threads.emplace_back([this, _threadInit] {
+				const std::optional<uint32_t> cpu = cpus.empty() ? std::nullopt : std::optional<uint32_t>(cpus[i]);
+				threads.emplace_back([this, _threadInit, i, cpu] {
+					// Pin before the thread state exists, so that it's allocated on the worker's node
+					if (cpu)
+					{
+						NumaTopology::PinCurrentThread(*cpu);
+					}
 					TThreadStateType threadState(_threadInit());
 
+					WorkerContext worker;
+					worker.Owner = this;
+					worker.Index = i;
+					worker.ThreadState = &threadState;
+					worker.VictimGenerator.seed(i + 1);
+					s_Worker = &worker;
+
 					while (true)
 					{
 						JobType task;
+						if (TryGetJob(worker, task))
 						{
-							std::unique_lock<std::mutex> lock(m_TaskQueueMutex);
-							m_JobReady.wait(lock,
-								[this] { return m_Done || !m_TaskQueue.empty(); });
-							if (m_Done && m_TaskQueue.empty())
-								return;
-							task = std::move(m_TaskQueue.front());
-							m_TaskQueue.pop();
+							task(threadState);
+							continue;
 						}
 
-						task(threadState);
+						std::unique_lock<std::mutex> lock(m_SleepMutex);
+						m_SleepingWorkers.fetch_add(1);
+						m_JobReady.wait(lock,
+							[this] { return m_Done || m_PendingJobs.load() > 0; });
+						m_SleepingWorkers.fetch_sub(1);
+						if (m_Done && m_PendingJobs.load() == 0)
+							break;
 					}
+					s_Worker = nullptr;
 				}
 				);
 			}
 			return threads;
 		}
 
-		std::mutex m_TaskQueueMutex;
+		static uint32_t GetThreadCount(int _numThreads)
+		{
+			return _numThreads == -1 ? GetMaxWorkerThreads() : std::max(1u, uint32_t(_numThreads));
+		}
+
+		inline static thread_local WorkerContext* s_Worker = nullptr;
+
+		std::vector<WorkStealingQueue<JobType>> m_Queues;
+		std::atomic<uint32_t> m_NextQueue = 0;
+		std::atomic<uint32_t> m_PendingJobs = 0;
+		std::atomic<uint32_t> m_SleepingWorkers = 0;
+
+		std::mutex m_SleepMutex;
 		std::atomic<bool> m_Done = false;
-		std::queue<JobType> m_TaskQueue;
 		std::condition_variable m_JobReady;
+		uint32_t m_NodeCount = 1;
+		std::vector<uint32_t> m_WorkerNodes;
 		std::vector<std::thread> m_WorkerThreads;
 	};
 
 	template<typename TThreadStateType>
-	JobManager<TThreadStateType>::JobManager(std::function<TThreadStateType()> _threadInit, int _numThreads) :
-		m_WorkerThreads(InitThreads(_threadInit, _numThreads == -1 ? GetMaxWorkerThreads() : (uint32_t)_numThreads))
+	JobManager<TThreadStateType>::JobManager(std::function<TThreadStateType()> _threadInit, int _numThreads, EThreadAffinity _affinity) :
+		m_Queues(GetThreadCount(_numThreads)),
+		m_WorkerThreads(InitThreads(_threadInit, GetThreadCount(_numThreads), _affinity))
 	{
 	}
 }
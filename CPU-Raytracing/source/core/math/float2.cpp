@@ -3,6 +3,7 @@
 #include "./core/math/float4.h"
 
 #include <sstream>
+#include <cmath>
 
 namespace CRT
 {
@@ -1,100 +1,270 @@
 #pragma once
+#include "./core/math/float2.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <sstream>
 #include <string>
 
+// Backs float3 and float4 with an __m128, for the element wise operations, min, max and the dot product. A
+// float3 takes 16 bytes and is aligned to them then, and the operations can't be constexpr
+#if defined(CRT_SIMD_VECTORS)
+#include <smmintrin.h>
+#define CRT_VECTOR_CONSTEXPR inline
+#else
+#define CRT_VECTOR_CONSTEXPR constexpr
+#endif
+
 namespace CRT
 {
-	class float2;
 	class float4;
 
+	// Defined in the header, so the vector math of the inner loops is inlined into them
 	class float3
 	{
 	public:
-		float3();
-		float3(float _s);
-		float3(float _x, float _y, float _z);
-		float3(const float2& _v);
-		float3(const float2& _v, float _z);
-		float3(const float4& _v);
-
-		static float3 Up();
-		static float3 Down();
-		static float3 Left();
-		static float3 Right();
-		static float3 Forward();
-		static float3 Back();
-
-		static float3 Zero();
-		static float3 One();
-		static float3 Infinity();
-		static float3 NegativeInfinity();
-
-		static float3 XAxis();
-		static float3 YAxis();
-		static float3 ZAxis();
-
-		static float3 ComponentMin(std::initializer_list<float3> values);
-		static float3 ComponentMax(std::initializer_list<float3> values);
-
-		float3& Add(const float3& _o);
-		float3& Subtract(const float3& _o);
-		float3& Multiply(const float3& _o);
-		float3& Divide(const float3& _o);
-
-		float3& Add(float _f);
-		float3& Subtract(float _f);
-		float3& Multiply(float _f);
-		float3& Divide(float _f);
-
-		friend float3 operator+(float3 _l, const float3& _r);
-		friend float3 operator-(float3 _l, const float3& _r);
-		friend float3 operator*(float3 _l, const float3& _r);
-		friend float3 operator/(float3 _l, const float3& _r);
-
-		friend float3 operator+(float3 _l, float _f);
-		friend float3 operator-(float3 _l, float _f);
-		friend float3 operator*(float3 _l, float _f);
-		friend float3 operator/(float3 _l, float _f);
-
-		friend float3 operator-(const float3& _v);
-
-		bool operator==(const float3& _o) const;
-		bool operator!=(const float3& _o) const;
-
-		float3& operator+=(const float3& _o);
-		float3& operator-=(const float3& _o);
-		float3& operator*=(const float3& _o);
-		float3& operator/=(const float3& _o);
-
-		float3& operator+=(float _o);
-		float3& operator-=(float _o);
-		float3& operator*=(float _o);
-		float3& operator/=(float _o);
-
-		bool operator< (const float3& _o) const;
-		bool operator<=(const float3& _o) const;
-		bool operator> (const float3& _o) const;
-		bool operator>=(const float3& _o) const;
-
-		float3 Normalize() const;
-		float3 Cross(const float3& _o) const;
-		float  Dot(const float3& _o) const;
-
-		float Magnitude() const;
-		float Distance(const float3& _o) const;
-		float DistanceSquared(const float3& _o) const;
-		float MagnitudeSquared() const;
-
-		float3 ComponentMin(float3 other) const;
-		float3 ComponentMax(float3 other) const;
-
-		float3 Abs() const; 
-
-		std::string ToString() const;
+#if defined(CRT_SIMD_VECTORS)
+		float3()
+			: m(_mm_setzero_ps())
+		{ }
+
+		float3(float _s)
+			: m(_mm_setr_ps(_s, _s, _s, 0.0f))
+		{ }
+
+		float3(float _x, float _y, float _z)
+			: m(_mm_setr_ps(_x, _y, _z, 0.0f))
+		{ }
+
+		explicit float3(__m128 _m)
+			: m(_m)
+		{ }
+#else
+		constexpr float3()
+			: x(0.0f)
+			, y(0.0f)
+			, z(0.0f)
+		{ }
+
+		constexpr float3(float _s)
+			: x(_s)
+			, y(_s)
+			, z(_s)
+		{ }
+
+		constexpr float3(float _x, float _y, float _z)
+			: x(_x)
+			, y(_y)
+			, z(_z)
+		{ }
+#endif
+		float3(const float2& _v)
+			: float3(_v.x, _v.y, 0.0f)
+		{ }
+
+		float3(const float2& _v, float _z)
+			: float3(_v.x, _v.y, _z)
+		{ }
+
+		// Defined with float4
+		CRT_VECTOR_CONSTEXPR float3(const float4& _v);
+
+		static CRT_VECTOR_CONSTEXPR float3 Up() { return float3(0.0f, 1.0f, 0.0f); }
+		static CRT_VECTOR_CONSTEXPR float3 Down() { return float3(0.0f, -1.0f, 0.0f); }
+		static CRT_VECTOR_CONSTEXPR float3 Left() { return float3(-1.0f, 0.0f, 0.0f); }
+		static CRT_VECTOR_CONSTEXPR float3 Right() { return float3(1.0f, 0.0f, 0.0f); }
+		static CRT_VECTOR_CONSTEXPR float3 Forward() { return float3(0.0f, 0.0f, -1.0f); }
+		static CRT_VECTOR_CONSTEXPR float3 Back() { return float3(0.0f, 0.0f, 1.0f); }
+
+		static CRT_VECTOR_CONSTEXPR float3 Zero() { return float3(0.0f, 0.0f, 0.0f); }
+		static CRT_VECTOR_CONSTEXPR float3 One() { return float3(1.0f, 1.0f, 1.0f); }
+		static CRT_VECTOR_CONSTEXPR float3 Infinity() { return float3(std::numeric_limits<float>::infinity()); }
+		static CRT_VECTOR_CONSTEXPR float3 NegativeInfinity() { return float3(-std::numeric_limits<float>::infinity()); }
+
+		static CRT_VECTOR_CONSTEXPR float3 XAxis() { return float3(1.0f, 0.0f, 0.0f); }
+		static CRT_VECTOR_CONSTEXPR float3 YAxis() { return float3(0.0f, 1.0f, 0.0f); }
+		static CRT_VECTOR_CONSTEXPR float3 ZAxis() { return float3(0.0f, 0.0f, 1.0f); }
+
+		static CRT_VECTOR_CONSTEXPR float3 ComponentMin(std::initializer_list<float3> values)
+		{
+			float3 min = *values.begin();
+			for (const float3& value : values)
+			{
+				min = min.ComponentMin(value);
+			}
+			return min;
+		}
+
+		static CRT_VECTOR_CONSTEXPR float3 ComponentMax(std::initializer_list<float3> values)
+		{
+			float3 max = *values.begin();
+			for (const float3& value : values)
+			{
+				max = max.ComponentMax(value);
+			}
+			return max;
+		}
+
+		CRT_VECTOR_CONSTEXPR float3& Add(const float3& _o)
+		{
+#if defined(CRT_SIMD_VECTORS)
+			m = _mm_add_ps(m, _o.m);
+#else
+			x += _o.x;
+			y += _o.y;
+			z += _o.z;
+#endif
+			return *this;
+		}
+
+		CRT_VECTOR_CONSTEXPR float3& Subtract(const float3& _o)
+		{
+#if defined(CRT_SIMD_VECTORS)
+			m = _mm_sub_ps(m, _o.m);
+#else
+			x -= _o.x;
+			y -= _o.y;
+			z -= _o.z;
+#endif
+			return *this;
+		}
+
+		CRT_VECTOR_CONSTEXPR float3& Multiply(const float3& _o)
+		{
+#if defined(CRT_SIMD_VECTORS)
+			m = _mm_mul_ps(m, _o.m);
+#else
+			x *= _o.x;
+			y *= _o.y;
+			z *= _o.z;
+#endif
+			return *this;
+		}
+
+		CRT_VECTOR_CONSTEXPR float3& Divide(const float3& _o)
+		{
+#if defined(CRT_SIMD_VECTORS)
+			// The fourth lanes are zero, 0 / 0 leaves a NaN there that nothing reads
+			m = _mm_div_ps(m, _o.m);
+#else
+			x /= _o.x;
+			y /= _o.y;
+			z /= _o.z;
+#endif
+			return *this;
+		}
+
+		CRT_VECTOR_CONSTEXPR float3& Add(float _f) { return Add(float3(_f)); }
+		CRT_VECTOR_CONSTEXPR float3& Subtract(float _f) { return Subtract(float3(_f)); }
+		CRT_VECTOR_CONSTEXPR float3& Multiply(float _f) { return Multiply(float3(_f)); }
+		CRT_VECTOR_CONSTEXPR float3& Divide(float _f) { return Divide(float3(_f)); }
+
+		friend CRT_VECTOR_CONSTEXPR float3 operator+(float3 _l, const float3& _r) { return _l.Add(_r); }
+		friend CRT_VECTOR_CONSTEXPR float3 operator-(float3 _l, const float3& _r) { return _l.Subtract(_r); }
+		friend CRT_VECTOR_CONSTEXPR float3 operator*(float3 _l, const float3& _r) { return _l.Multiply(_r); }
+		friend CRT_VECTOR_CONSTEXPR float3 operator/(float3 _l, const float3& _r) { return _l.Divide(_r); }
+
+		friend CRT_VECTOR_CONSTEXPR float3 operator+(float3 _l, float _f) { return _l.Add(_f); }
+		friend CRT_VECTOR_CONSTEXPR float3 operator-(float3 _l, float _f) { return _l.Subtract(_f); }
+		friend CRT_VECTOR_CONSTEXPR float3 operator*(float3 _l, float _f) { return _l.Multiply(_f); }
+		friend CRT_VECTOR_CONSTEXPR float3 operator/(float3 _l, float _f) { return _l.Divide(_f); }
+
+		friend CRT_VECTOR_CONSTEXPR float3 operator-(const float3& _v) { return float3(-_v.x, -_v.y, -_v.z); }
+
+		CRT_VECTOR_CONSTEXPR bool operator==(const float3& _o) const { return x == _o.x && y == _o.y && z == _o.z; }
+		CRT_VECTOR_CONSTEXPR bool operator!=(const float3& _o) const { return !(*this == _o); }
+
+		CRT_VECTOR_CONSTEXPR float3& operator+=(const float3& _o) { return Add(_o); }
+		CRT_VECTOR_CONSTEXPR float3& operator-=(const float3& _o) { return Subtract(_o); }
+		CRT_VECTOR_CONSTEXPR float3& operator*=(const float3& _o) { return Multiply(_o); }
+		CRT_VECTOR_CONSTEXPR float3& operator/=(const float3& _o) { return Divide(_o); }
+
+		CRT_VECTOR_CONSTEXPR float3& operator+=(float _o) { return Add(_o); }
+		CRT_VECTOR_CONSTEXPR float3& operator-=(float _o) { return Subtract(_o); }
+		CRT_VECTOR_CONSTEXPR float3& operator*=(float _o) { return Multiply(_o); }
+		CRT_VECTOR_CONSTEXPR float3& operator/=(float _o) { return Divide(_o); }
+
+		CRT_VECTOR_CONSTEXPR bool operator< (const float3& _o) const { return x < _o.x && y < _o.y && z < _o.z; }
+		CRT_VECTOR_CONSTEXPR bool operator<=(const float3& _o) const { return x <= _o.x && y <= _o.y && z <= _o.z; }
+		CRT_VECTOR_CONSTEXPR bool operator> (const float3& _o) const { return x > _o.x && y > _o.y && z > _o.z; }
+		CRT_VECTOR_CONSTEXPR bool operator>=(const float3& _o) const { return x >= _o.x && y >= _o.y && z >= _o.z; }
+
+		float3 Normalize() const
+		{
+#if defined(CRT_SIMD_VECTORS)
+			return float3(_mm_div_ps(m, _mm_set1_ps(Magnitude())));
+#else
+			const float length = Magnitude();
+			return float3(x / length, y / length, z / length);
+#endif
+		}
+
+		CRT_VECTOR_CONSTEXPR float3 Cross(const float3& _o) const
+		{
+#if defined(CRT_SIMD_VECTORS)
+			// a * b.yzx - a.yzx * b is the cross product in zxy order
+			const __m128 rotated = _mm_sub_ps(_mm_mul_ps(m, _mm_shuffle_ps(_o.m, _o.m, _MM_SHUFFLE(3, 0, 2, 1))),
+				_mm_mul_ps(_mm_shuffle_ps(m, m, _MM_SHUFFLE(3, 0, 2, 1)), _o.m));
+			return float3(_mm_shuffle_ps(rotated, rotated, _MM_SHUFFLE(3, 0, 2, 1)));
+#else
+			return float3(y * _o.z - z * _o.y, z * _o.x - x * _o.z, x * _o.y - y * _o.x);
+#endif
+		}
+
+		CRT_VECTOR_CONSTEXPR float Dot(const float3& _o) const
+		{
+#if defined(CRT_SIMD_VECTORS)
+			// Summed in the same order as without the backing, and only the first three lanes, a division leaves
+			// a NaN in the fourth
+			const __m128 products = _mm_mul_ps(m, _o.m);
+			const __m128 xy = _mm_add_ss(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1)));
+			return _mm_cvtss_f32(_mm_add_ss(xy, _mm_movehl_ps(products, products)));
+#else
+			return x * _o.x + y * _o.y + z * _o.z;
+#endif
+		}
+
+		float Magnitude() const { return std::sqrt(MagnitudeSquared()); }
+		float Distance(const float3& _o) const { return std::sqrt(DistanceSquared(_o)); }
+		CRT_VECTOR_CONSTEXPR float DistanceSquared(const float3& _o) const { return (*this - _o).MagnitudeSquared(); }
+		CRT_VECTOR_CONSTEXPR float MagnitudeSquared() const { return Dot(*this); }
+
+		CRT_VECTOR_CONSTEXPR float3 ComponentMin(float3 other) const
+		{
+#if defined(CRT_SIMD_VECTORS)
+			return float3(_mm_min_ps(m, other.m));
+#else
+			return float3(std::min(x, other.x), std::min(y, other.y), std::min(z, other.z));
+#endif
+		}
+
+		CRT_VECTOR_CONSTEXPR float3 ComponentMax(float3 other) const
+		{
+#if defined(CRT_SIMD_VECTORS)
+			return float3(_mm_max_ps(m, other.m));
+#else
+			return float3(std::max(x, other.x), std::max(y, other.y), std::max(z, other.z));
+#endif
+		}
+
+		float3 Abs() const { return float3(std::abs(x), std::abs(y), std::abs(z)); }
+
+		std::string ToString() const
+		{
+			std::stringstream result;
+			result << "float3(" << x << ", " << y << ", " << z << ")";
+			return result.str();
+		}
 
 		union
 		{
 			float f[3];
 			struct { float x, y, z; };
+#if defined(CRT_SIMD_VECTORS)
+			__m128 m;
+#endif
 		};
 	};
-}
\ No newline at end of file
+}
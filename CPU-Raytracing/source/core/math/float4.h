@@ -1,71 +1,179 @@
 #pragma once
+#include "./core/math/float2.h"
+#include "./core/math/float3.h"
+
+#include <sstream>
 #include <string>
 
 namespace CRT
 {
-	class float2;
-	class float3;
-
+	// Defined in the header like float3, and backed by an __m128 with CRT_SIMD_VECTORS as well
 	class float4
 	{
 	public:
-		float4();
-		float4(float _s);
-		float4(float _x, float _y, float _z, float _w);
-		float4(const float2& _v);
-		float4(const float3& _v);
+#if defined(CRT_SIMD_VECTORS)
+		float4()
+			: m(_mm_setzero_ps())
+		{ }
+
+		float4(float _s)
+			: m(_mm_set1_ps(_s))
+		{ }
+
+		float4(float _x, float _y, float _z, float _w)
+			: m(_mm_setr_ps(_x, _y, _z, _w))
+		{ }
+
+		explicit float4(__m128 _m)
+			: m(_m)
+		{ }
+#else
+		constexpr float4()
+			: x(0.0f)
+			, y(0.0f)
+			, z(0.0f)
+			, w(0.0f)
+		{ }
+
+		constexpr float4(float _s)
+			: x(_s)
+			, y(_s)
+			, z(_s)
+			, w(_s)
+		{ }
+
+		constexpr float4(float _x, float _y, float _z, float _w)
+			: x(_x)
+			, y(_y)
+			, z(_z)
+			, w(_w)
+		{ }
+#endif
+		float4(const float2& _v)
+			: float4(_v.x, _v.y, 0.0f, 0.0f)
+		{ }
+
+		CRT_VECTOR_CONSTEXPR float4(const float3& _v)
+			: float4(_v.x, _v.y, _v.z, 0.0f)
+		{ }
+
+		static CRT_VECTOR_CONSTEXPR float4 Zero() { return float4(0.0f, 0.0f, 0.0f, 0.0f); }
+		static CRT_VECTOR_CONSTEXPR float4 One() { return float4(1.0f, 1.0f, 1.0f, 1.0f); }
 
-		static float4 Zero();
-		static float4 One();
+		CRT_VECTOR_CONSTEXPR float4& Add(const float4& _o)
+		{
+#if defined(CRT_SIMD_VECTORS)
+			m = _mm_add_ps(m, _o.m);
+#else
+			x += _o.x;
+			y += _o.y;
+			z += _o.z;
+			w += _o.w;
+#endif
+			return *this;
+		}
 
-		float4& Add(const float4& _o);
-		float4& Subtract(const float4& _o);
-		float4& Multiply(const float4& _o);
-		float4& Divide(const float4& _o);
+		CRT_VECTOR_CONSTEXPR float4& Subtract(const float4& _o)
+		{
+#if defined(CRT_SIMD_VECTORS)
+			m = _mm_sub_ps(m, _o.m);
+#else
+			x -= _o.x;
+			y -= _o.y;
+			z -= _o.z;
+			w -= _o.w;
+#endif
+			return *this;
+		}
 
-		float4& Add(float _f);
-		float4& Subtract(float _f);
-		float4& Multiply(float _f);
-		float4& Divide(float _f);
+		CRT_VECTOR_CONSTEXPR float4& Multiply(const float4& _o)
+		{
+#if defined(CRT_SIMD_VECTORS)
+			m = _mm_mul_ps(m, _o.m);
+#else
+			x *= _o.x;
+			y *= _o.y;
+			z *= _o.z;
+			w *= _o.w;
+#endif
+			return *this;
+		}
 
-		friend float4 operator+(float4 _l, const float4& _r);
-		friend float4 operator-(float4 _l, const float4& _r);
-		friend float4 operator*(float4 _l, const float4& _r);
-		friend float4 operator/(float4 _l, const float4& _r);
+		CRT_VECTOR_CONSTEXPR float4& Divide(const float4& _o)
+		{
+#if defined(CRT_SIMD_VECTORS)
+			m = _mm_div_ps(m, _o.m);
+#else
+			x /= _o.x;
+			y /= _o.y;
+			z /= _o.z;
+			w /= _o.w;
+#endif
+			return *this;
+		}
 
-		friend float4 operator+(float4 _l, float _f);
-		friend float4 operator-(float4 _l, float _f);
-		friend float4 operator*(float4 _l, float _f);
-		friend float4 operator/(float4 _l, float _f);
+		CRT_VECTOR_CONSTEXPR float4& Add(float _f) { return Add(float4(_f)); }
+		CRT_VECTOR_CONSTEXPR float4& Subtract(float _f) { return Subtract(float4(_f)); }
+		CRT_VECTOR_CONSTEXPR float4& Multiply(float _f) { return Multiply(float4(_f)); }
+		CRT_VECTOR_CONSTEXPR float4& Divide(float _f) { return Divide(float4(_f)); }
 
-		friend float4 operator-(const float4& _v);
+		friend CRT_VECTOR_CONSTEXPR float4 operator+(float4 _l, const float4& _r) { return _l.Add(_r); }
+		friend CRT_VECTOR_CONSTEXPR float4 operator-(float4 _l, const float4& _r) { return _l.Subtract(_r); }
+		friend CRT_VECTOR_CONSTEXPR float4 operator*(float4 _l, const float4& _r) { return _l.Multiply(_r); }
+		friend CRT_VECTOR_CONSTEXPR float4 operator/(float4 _l, const float4& _r) { return _l.Divide(_r); }
 
-		bool operator==(const float4& _o) const;
-		bool operator!=(const float4& _o) const;
+		friend CRT_VECTOR_CONSTEXPR float4 operator+(float4 _l, float _f) { return _l.Add(_f); }
+		friend CRT_VECTOR_CONSTEXPR float4 operator-(float4 _l, float _f) { return _l.Subtract(_f); }
+		friend CRT_VECTOR_CONSTEXPR float4 operator*(float4 _l, float _f) { return _l.Multiply(_f); }
+		friend CRT_VECTOR_CONSTEXPR float4 operator/(float4 _l, float _f) { return _l.Divide(_f); }
 
-		float4& operator+=(const float4& _o);
-		float4& operator-=(const float4& _o);
-		float4& operator*=(const float4& _o);
-		float4& operator/=(const float4& _o);
+		friend CRT_VECTOR_CONSTEXPR float4 operator-(const float4& _v) { return float4(-_v.x, -_v.y, -_v.z, -_v.w); }
 
-		float4& operator+=(float _o);
-		float4& operator-=(float _o);
-		float4& operator*=(float _o);
-		float4& operator/=(float _o);
+		CRT_VECTOR_CONSTEXPR bool operator==(const float4& _o) const { return x == _o.x && y == _o.y && z == _o.z && w == _o.w; }
+		CRT_VECTOR_CONSTEXPR bool operator!=(const float4& _o) const { return !(*this == _o); }
 
-		bool operator< (const float4& _o) const;
-		bool operator<=(const float4& _o) const;
-		bool operator> (const float4& _o) const;
-		bool operator>=(const float4& _o) const;
+		CRT_VECTOR_CONSTEXPR float4& operator+=(const float4& _o) { return Add(_o); }
+		CRT_VECTOR_CONSTEXPR float4& operator-=(const float4& _o) { return Subtract(_o); }
+		CRT_VECTOR_CONSTEXPR float4& operator*=(const float4& _o) { return Multiply(_o); }
+		CRT_VECTOR_CONSTEXPR float4& operator/=(const float4& _o) { return Divide(_o); }
 
-		float  Dot(const float4& _o) const;
+		CRT_VECTOR_CONSTEXPR float4& operator+=(float _o) { return Add(_o); }
+		CRT_VECTOR_CONSTEXPR float4& operator-=(float _o) { return Subtract(_o); }
+		CRT_VECTOR_CONSTEXPR float4& operator*=(float _o) { return Multiply(_o); }
+		CRT_VECTOR_CONSTEXPR float4& operator/=(float _o) { return Divide(_o); }
 
-		std::string ToString() const;
+		CRT_VECTOR_CONSTEXPR bool operator< (const float4& _o) const { return x < _o.x && y < _o.y && z < _o.z && w < _o.w; }
+		CRT_VECTOR_CONSTEXPR bool operator<=(const float4& _o) const { return x <= _o.x && y <= _o.y && z <= _o.z && w <= _o.w; }
+		CRT_VECTOR_CONSTEXPR bool operator> (const float4& _o) const { return x > _o.x && y > _o.y && z > _o.z && w > _o.w; }
+		CRT_VECTOR_CONSTEXPR bool operator>=(const float4& _o) const { return x >= _o.x && y >= _o.y && z >= _o.z && w >= _o.w; }
+
+		CRT_VECTOR_CONSTEXPR float Dot(const float4& _o) const
+		{
+#if defined(CRT_SIMD_VECTORS)
+			return _mm_cvtss_f32(_mm_dp_ps(m, _o.m, 0xf1));
+#else
+			return x * _o.x + y * _o.y + z * _o.z + w * _o.w;
+#endif
+		}
+
+		std::string ToString() const
+		{
+			std::stringstream result;
+			result << "float4(" << x << ", " << y << ", " << z << ", " << w << ")";
+			return result.str();
+		}
 
 		union
 		{
 			float f[4];
 			struct { float x, y, z, w; };
+#if defined(CRT_SIMD_VECTORS)
+			__m128 m;
+#endif
 		};
 	};
-}
\ No newline at end of file
+
+	CRT_VECTOR_CONSTEXPR float3::float3(const float4& _v)
+		: float3(_v.x, _v.y, _v.z)
+	{ }
+}
@@ -0,0 +1,178 @@
+#include "./core/numa_topology.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#endif
+
+#include <algorithm>
+#include <thread>
+
+namespace CRT
+{
+	namespace
+	{
+#if defined(_WIN32)
+		std::vector<NumaNode> QueryNodes()
+		{
+			std::vector<NumaNode> nodes;
+			ULONG highestNode = 0;
+			if (!GetNumaHighestNodeNumber(&highestNode))
+			{
+				return nodes;
+			}
+			for (USHORT node = 0; node <= highestNode; node++)
+			{
+				GROUP_AFFINITY affinity;
+				if (!GetNumaNodeProcessorMaskEx(node, &affinity) || affinity.Mask == 0)
+				{
+					continue;
+				}
+				// Processor ids are numbered across groups of 64, the way PinCurrentThread expects them
+				NumaNode numaNode{ uint32_t(node), {} };
+				for (uint32_t bit = 0; bit < 64; bit++)
+				{
+					if (affinity.Mask & (KAFFINITY(1) << bit))
+					{
+						numaNode.CPUs.push_back(uint32_t(affinity.Group) * 64 + bit);
+					}
+				}
+				nodes.push_back(std::move(numaNode));
+			}
+			return nodes;
+		}
+#else
+		// Lists look like "0-15,32-47", for CPUs as well as nodes
+		std::vector<uint32_t> ParseCPUList(const std::string& _list)
+		{
+			std::vector<uint32_t> cpus;
+			std::stringstream stream(_list);
+			std::string range;
+			while (std::getline(stream, range, ','))
+			{
+				uint32_t first = 0;
+				uint32_t last = 0;
+				const int count = std::sscanf(range.c_str(), "%u-%u", &first, &last);
+				if (count < 1)
+				{
+					continue;
+				}
+				last = count == 2 ? last : first;
+				for (uint32_t cpu = first; cpu <= last; cpu++)
+				{
+					cpus.push_back(cpu);
+				}
+			}
+			return cpus;
+		}
+
+		std::string ReadLine(const std::string& _filepath)
+		{
+			std::ifstream file(_filepath);
+			std::string line;
+			std::getline(file, line);
+			return line;
+		}
+
+		std::vector<NumaNode> QueryNodes()
+		{
+			std::vector<NumaNode> nodes;
+			// Node numbers can have gaps, so go by the list of nodes that are online
+			for (uint32_t node : ParseCPUList(ReadLine("/sys/devices/system/node/online")))
+			{
+				std::vector<uint32_t> cpus = ParseCPUList(ReadLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+				if (!cpus.empty())
+				{
+					nodes.push_back(NumaNode{ node, std::move(cpus) });
+				}
+			}
+			return nodes;
+		}
+#endif
+
+		std::vector<NumaNode> CreateNodes()
+		{
+			std::vector<NumaNode> nodes = QueryNodes();
+			if (nodes.empty())
+			{
+				NumaNode node{ 0, std::vector<uint32_t>(std::max(1u, std::thread::hardware_concurrency())) };
+				for (uint32_t cpu = 0; cpu < uint32_t(node.CPUs.size()); cpu++)
+				{
+					node.CPUs[cpu] = cpu;
+				}
+				nodes.push_back(std::move(node));
+			}
+			return nodes;
+		}
+	}
+
+	const std::vector<NumaNode>& NumaTopology::GetNodes()
+	{
+		static const std::vector<NumaNode> nodes = CreateNodes();
+		return nodes;
+	}
+
+	uint32_t NumaTopology::GetNodeCount()
+	{
+		return uint32_t(GetNodes().size());
+	}
+
+	bool NumaTopology::PinCurrentThread(uint32_t _cpu)
+	{
+#if defined(_WIN32)
+		GROUP_AFFINITY affinity = {};
+		affinity.Group = WORD(_cpu / 64);
+		affinity.Mask = KAFFINITY(1) << (_cpu % 64);
+		return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(_cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+	}
+
+	void NumaTopology::InterleaveMemory(const void* _data, size_t _size)
+	{
+#if defined(_WIN32)
+		(void)_data;
+		(void)_size;
+#else
+		const uint32_t nodeCount = GetNodeCount();
+		if (nodeCount < 2 || _size == 0)
+		{
+			return;
+		}
+		// Policies apply to whole pages, only the pages completely inside the range are moved
+		const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+		const uintptr_t begin = (reinterpret_cast<uintptr_t>(_data) + pageSize - 1) / pageSize * pageSize;
+		const uintptr_t end = (reinterpret_cast<uintptr_t>(_data) + _size) / pageSize * pageSize;
+		if (begin >= end)
+		{
+			return;
+		}
+
+		// mbind through syscall to not depend on libnuma
+		const int InterleavePolicy = 3; // MPOL_INTERLEAVE
+		const unsigned MoveFlag = 1u << 1; // MPOL_MF_MOVE
+		const uint32_t BitsPerMask = sizeof(unsigned long) * 8;
+		const uint32_t maxNode = GetNodes().back().Id;
+		std::vector<unsigned long> mask(maxNode / BitsPerMask + 1, 0ul);
+		for (const NumaNode& node : GetNodes())
+		{
+			mask[node.Id / BitsPerMask] |= 1ul << (node.Id % BitsPerMask);
+		}
+		syscall(SYS_mbind, begin, end - begin, InterleavePolicy, mask.data(), (unsigned long)maxNode + 2, MoveFlag);
+#endif
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace CRT
+{
+	struct NumaNode
+	{
+		// The operating system's number for the node
+		uint32_t Id;
+		std::vector<uint32_t> CPUs;
+	};
+
+	// Which CPUs belong to which NUMA node, queried once. Machines that aren't NUMA, or where the
+	// topology can't be read, show up as a single node with every CPU
+	class NumaTopology
+	{
+	public:
+		// Only nodes with CPUs, memory only nodes don't run workers
+		static const std::vector<NumaNode>& GetNodes();
+		static uint32_t GetNodeCount();
+
+		static bool PinCurrentThread(uint32_t _cpu);
+		// Spreads the pages of the range round robin over all nodes, so every node's workers read part of
+		// it locally instead of all of it from the node that allocated it. Only implemented on Linux
+		static void InterleaveMemory(const void* _data, size_t _size);
+	};
+}
@@ -4,7 +4,8 @@
 namespace CRT
 {
 	RandomGenerator::RandomGenerator(uint32_t _seed) :
-		m_State(_seed)
+		// Xorshift gets stuck on a zero state
+		m_State(_seed == 0 ? 1u : _seed)
 	{
 	}
 
@@ -12,8 +13,9 @@ namespace CRT
 	{
 		uint32_t state = m_State;
 		state ^= (state << 13);
-		state ^= (state << 17);
+		state ^= (state >> 17);
 		state ^= (state << 5);
+		m_State = state;
 		constexpr float Multiplier = 1.0f / std::numeric_limits<uint32_t>::max();
 		return state * Multiplier;
 	}
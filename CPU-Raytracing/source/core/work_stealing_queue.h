@@ -0,0 +1,49 @@
+#pragma once
+#include <deque>
+#include <mutex>
+
+namespace CRT
+{
+	// Double ended queue owned by a single worker. The owner pushes and pops at the back (LIFO), so
+	// it keeps working on the most recent, cache-warm jobs, while other workers steal from the front.
+	// Aligned to a cache line so that the locks of neighbouring workers don't share one
+	template<typename TJobType>
+	class alignas(64) WorkStealingQueue
+	{
+	public:
+		void Push(TJobType _job)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Jobs.emplace_back(std::move(_job));
+		}
+
+		bool Pop(TJobType& _job)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (m_Jobs.empty())
+			{
+				return false;
+			}
+			_job = std::move(m_Jobs.back());
+			m_Jobs.pop_back();
+			return true;
+		}
+
+		bool Steal(TJobType& _job)
+		{
+			// Don't wait for the owner, there's likely another victim with work available
+			std::unique_lock<std::mutex> lock(m_Mutex, std::try_to_lock);
+			if (!lock.owns_lock() || m_Jobs.empty())
+			{
+				return false;
+			}
+			_job = std::move(m_Jobs.front());
+			m_Jobs.pop_front();
+			return true;
+		}
+
+	private:
+		std::mutex m_Mutex;
+		std::deque<TJobType> m_Jobs;
+	};
+}
@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+
+#include "./core/cpu_features.h"
+#include "./core/graphics/color3.h"
+#include "./core/graphics/image_writing.h"
+#include "./core/math/trigonometry.h"
+
+#include "./core/graphics/screen/pixel_packing.h"
+
+#include "./raytracing/camera.h"
+#include "./raytracing/raytracer.h"
+
+#include "./scene/scene_loading.h"
+#include "./benchmarking/coherence_benchmark.h"
+#include "./benchmarking/timer.h"
+#include "./benchmarking/vector_benchmark.h"
+
+#if defined(CRT_NETWORK)
+#include "./network/render_client.h"
+#include "./network/render_coordinator.h"
+#include "./network/render_server.h"
+#include "./network/render_worker.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace CRT;
+
+// Renders a single image without a window, for machines without a display or OpenGL
+namespace
+{
+	struct Options
+	{
+		std::string ScenePath = "builtin";
+		std::string OutputPath = "render.png";
+		uint32_t Width = 1280;
+		uint32_t Height = 720;
+		uint32_t Samples = 16;
+		float FieldOfView = 90.0f;
+		float3 Position = float3(0.0f, 0.0f, 3.0f);
+		float3 Direction = float3(0.0f, 0.0f, -1.0f);
+		float AdaptiveThreshold = 0.005f;
+		uint32_t DenoiseIterations = 0;
+		EPathTermination PathTermination = EPathTermination::FixedDepth;
+		float ContributionThreshold = 0.05f;
+		uint32_t SplitDepth = UINT32_MAX;
+		bool RaySorting = false;
+		ETraversalMode TraversalMode = ETraversalMode::Packets;
+		EInstructionSet InstructionSet = CpuFeatures::GetSupportedInstructionSet();
+		int Threads = int(std::thread::hardware_concurrency());
+		EThreadAffinity Affinity = EThreadAffinity::None;
+		ETileOrder TileOrder = ETileOrder::Hilbert;
+		std::string CoordinatorAddress;
+		std::string WorkerAddress;
+		int SpawnedWorkers = 0;
+		std::string ServeAddress;
+		std::string ServerAddress;
+		uint32_t TileRowBegin = 0;
+		uint32_t TileRowEnd = UINT32_MAX;
+		std::string Benchmark;
+	};
+
+	void PrintUsage()
+	{
+		std::cout << "Usage: crt-headless [options]\n"
+			<< "  --scene <builtin|file>      scene to render, a model file or the built-in spheres (builtin), or\n"
+			<< "                              builtin-mirrors and builtin-glass, grids of mirror or glass spheres of triangles\n"
+			<< "  --output <file>             .png, .ppm or .exr (render.png)\n"
+			<< "  --width <pixels>            (1280)\n"
+			<< "  --height <pixels>           (720)\n"
+			<< "  --samples <count>           samples per pixel (16)\n"
+			<< "  --position <x,y,z>          camera position (0,0,3)\n"
+			<< "  --direction <x,y,z>         camera direction (0,0,-1)\n"
+			<< "  --fov <degrees>             horizontal field of view (90)\n"
+			<< "  --adaptive-threshold <err>  stop sampling a tile below this error, 0 samples everything (0.005)\n"
+			<< "  --denoise <iterations>      filter the result with the edge-avoiding denoiser, 0 turns it off (0)\n"
+			<< "  --path-termination <fixed|threshold|roulette>  end paths at the bounce limit, or when their contribution\n"
+			<< "                              to the pixel is below the threshold, or randomly below it without bias (fixed)\n"
+			<< "  --contribution-threshold <t>  contribution below which paths may end (0.05)\n"
+			<< "  --split-depth <bounces>     glass splits into two rays within this many bounces, deeper it picks one (always)\n"
+			<< "  --ray-sorting <on|off>      trace secondary and shadow rays sorted by direction and origin (off)\n"
+			<< "  --traversal <single|interleaved|treelets|packets>  trace one ray through the BVHs at a time, several at\n"
+			<< "                              once to overlap their cache misses, batches of them one treelet after the other,\n"
+			<< "                              or packets of 8 or 16 rays through the same nodes (packets)\n"
+			<< "  --isa <sse4|avx2|avx512>    instruction set of the kernels, at most what the CPU supports (the highest)\n"
+			<< "  --threads <count>           worker threads (all hardware threads)\n"
+			<< "  --affinity <none|numa>      pin the threads and spread them and the BVHs over the NUMA nodes (none)\n"
+			<< "  --tile-order <row|morton|hilbert>  order the tiles are traced in (hilbert)\n"
+			<< "  --benchmark coherence       time the mirror and glass spheres with ray sorting and each traversal instead\n"
+			<< "  --benchmark vectors         time the vector math of the slab and triangle tests and of shading instead\n"
+#if defined(CRT_NETWORK)
+			<< "Distributed rendering, addresses are host:port or unix:<path>:\n"
+			<< "  --coordinator <address>     hand out tile rows to workers connecting here and write the result\n"
+			<< "  --spawn-workers <count>     start this many local workers for the coordinator (0)\n"
+			<< "  --worker <address>          render for the coordinator at this address, scene and camera come from it\n"
+			<< "Render server:\n"
+			<< "  --serve <address>           keep scenes loaded and render requests sent with --server\n"
+			<< "  --server <address>          have the server at this address render the image\n"
+			<< "  --tile-rows <begin,end>     only render these rows of tiles, with --server\n"
+#endif
+			;
+	}
+
+	bool ParseFloat3(const std::string& _value, float3& _result)
+	{
+		return std::sscanf(_value.c_str(), "%f,%f,%f", &_result.x, &_result.y, &_result.z) == 3;
+	}
+
+	bool ParseOptions(int _argc, char** _argv, Options& _options)
+	{
+		for (int i = 1; i < _argc; i++)
+		{
+			const std::string option = _argv[i];
+			if (option == "--help" || option == "-h")
+			{
+				return false;
+			}
+			if (i + 1 >= _argc)
+			{
+				std::cout << "Missing value for " << option << "\n";
+				return false;
+			}
+
+			const std::string value = _argv[++i];
+			bool valid = true;
+			if (option == "--scene")
+				_options.ScenePath = value;
+			else if (option == "--output")
+				_options.OutputPath = value;
+			else if (option == "--width")
+				valid = (_options.Width = uint32_t(std::atoi(value.c_str()))) > 0;
+			else if (option == "--height")
+				valid = (_options.Height = uint32_t(std::atoi(value.c_str()))) > 0;
+			else if (option == "--samples")
+				valid = (_options.Samples = uint32_t(std::atoi(value.c_str()))) > 0;
+			else if (option == "--position")
+				valid = ParseFloat3(value, _options.Position);
+			else if (option == "--direction")
+				valid = ParseFloat3(value, _options.Direction);
+			else if (option == "--fov")
+				valid = (_options.FieldOfView = float(std::atof(value.c_str()))) > 0.0f;
+			else if (option == "--adaptive-threshold")
+				valid = (_options.AdaptiveThreshold = float(std::atof(value.c_str()))) >= 0.0f;
+			else if (option == "--denoise")
+				valid = (_options.DenoiseIterations = uint32_t(std::atoi(value.c_str()))) <= Denoiser::MaxIterations;
+			else if (option == "--path-termination")
+			{
+				valid = value == "fixed" || value == "threshold" || value == "roulette";
+				_options.PathTermination = value == "threshold" ? EPathTermination::ContributionThreshold
+					: value == "roulette" ? EPathTermination::RussianRoulette : EPathTermination::FixedDepth;
+			}
+			else if (option == "--contribution-threshold")
+				valid = (_options.ContributionThreshold = float(std::atof(value.c_str()))) >= 0.0f;
+			else if (option == "--split-depth")
+				_options.SplitDepth = uint32_t(std::atoi(value.c_str()));
+			else if (option == "--ray-sorting")
+			{
+				valid = value == "on" || value == "off";
+				_options.RaySorting = value == "on";
+			}
+			else if (option == "--traversal")
+			{
+				valid = value == "single" || value == "interleaved" || value == "treelets" || value == "packets";
+				_options.TraversalMode = value == "single" ? ETraversalMode::SingleRay
+					: value == "treelets" ? ETraversalMode::Treelets
+					: value == "packets" ? ETraversalMode::Packets : ETraversalMode::Interleaved;
+			}
+			else if (option == "--isa")
+			{
+				valid = value == "sse4" || value == "avx2" || value == "avx512";
+				_options.InstructionSet = value == "sse4" ? EInstructionSet::SSE4
+					: value == "avx2" ? EInstructionSet::AVX2 : EInstructionSet::AVX512;
+			}
+			else if (option == "--threads")
+				valid = (_options.Threads = std::atoi(value.c_str())) > 0;
+			else if (option == "--affinity")
+			{
+				valid = value == "none" || value == "numa";
+				_options.Affinity = value == "numa" ? EThreadAffinity::NUMANode : EThreadAffinity::None;
+			}
+			else if (option == "--tile-order")
+			{
+				valid = value == "row" || value == "morton" || value == "hilbert";
+				_options.TileOrder = value == "row" ? ETileOrder::RowMajor : value == "morton" ? ETileOrder::Morton : ETileOrder::Hilbert;
+			}
+			else if (option == "--benchmark")
+			{
+				valid = value == "coherence" || value == "vectors";
+				_options.Benchmark = value;
+			}
+#if defined(CRT_NETWORK)
+			else if (option == "--coordinator")
+				_options.CoordinatorAddress = value;
+			else if (option == "--spawn-workers")
+				valid = (_options.SpawnedWorkers = std::atoi(value.c_str())) > 0;
+			else if (option == "--worker")
+				_options.WorkerAddress = value;
+			else if (option == "--serve")
+				_options.ServeAddress = value;
+			else if (option == "--server")
+				_options.ServerAddress = value;
+			else if (option == "--tile-rows")
+				valid = std::sscanf(value.c_str(), "%u,%u", &_options.TileRowBegin, &_options.TileRowEnd) == 2
+					&& _options.TileRowBegin < _options.TileRowEnd;
+#endif
+			else
+			{
+				std::cout << "Unknown option " << option << "\n";
+				return false;
+			}
+
+			if (!valid)
+			{
+				std::cout << "Invalid value " << value << " for " << option << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+
+#if defined(CRT_NETWORK)
+	RenderSettings GetRenderSettings(const Options& _options)
+	{
+		return RenderSettings{ _options.Width, _options.Height, _options.Samples, _options.FieldOfView,
+			_options.AdaptiveThreshold, _options.DenoiseIterations, _options.PathTermination, _options.ContributionThreshold,
+			_options.SplitDepth, _options.Position, _options.Direction };
+	}
+
+	int RunCoordinator(const Options& _options)
+	{
+		RenderCoordinator coordinator(GetRenderSettings(_options), _options.ScenePath);
+		if (!coordinator.Listen(_options.CoordinatorAddress))
+		{
+			return 1;
+		}
+
+		// Forked before this process starts any thread, the local workers share the machine's threads. They
+		// aren't pinned, each of them would pin its threads to the same CPUs
+		std::vector<pid_t> workers;
+		const int workerThreads = std::max(1, _options.Threads / std::max(1, _options.SpawnedWorkers));
+		for (int i = 0; i < _options.SpawnedWorkers; i++)
+		{
+			const pid_t pid = fork();
+			if (pid == 0)
+			{
+				_exit(RenderWorker::Run(_options.CoordinatorAddress, workerThreads, EThreadAffinity::None) ? 0 : 1);
+			}
+			if (pid > 0)
+			{
+				workers.push_back(pid);
+			}
+		}
+
+		std::cout << "Waiting for workers on " << _options.CoordinatorAddress << "\n";
+		Timer renderTimer;
+		const bool rendered = coordinator.Run();
+		Timer::Duration renderDuration = renderTimer.GetDuration();
+		for (pid_t pid : workers)
+		{
+			waitpid(pid, nullptr, 0);
+		}
+		if (!rendered)
+		{
+			return 1;
+		}
+
+		const std::vector<float3>& image = coordinator.GetImage();
+		Surface surface(_options.Width, _options.Height);
+		PackPixels(image.data(), surface.GetBuffer(), uint32_t(image.size()));
+		bool written = ImageWriting::WriteImage(_options.OutputPath, surface, image);
+
+		std::cout << "Rendered " << _options.Width << "x" << _options.Height << " on " << coordinator.GetWorkerCount()
+			<< " workers in " << renderDuration.count() << " s\n";
+		if (written)
+		{
+			std::cout << "Wrote " << _options.OutputPath << "\n";
+		}
+		return written ? 0 : 1;
+	}
+
+	int RunClient(const Options& _options)
+	{
+		RegionHeader region{ _options.TileRowBegin, _options.TileRowEnd };
+		std::vector<float3> image;
+		Timer renderTimer;
+		if (!RenderClient::Render(_options.ServerAddress, GetRenderSettings(_options), _options.ScenePath, region, image))
+		{
+			return 1;
+		}
+		Timer::Duration renderDuration = renderTimer.GetDuration();
+
+		// A range of tile rows is written as an image of just those rows
+		const uint32_t height = uint32_t(image.size() / _options.Width);
+		Surface surface(_options.Width, height);
+		PackPixels(image.data(), surface.GetBuffer(), uint32_t(image.size()));
+		bool written = height > 0 && ImageWriting::WriteImage(_options.OutputPath, surface, image);
+
+		std::cout << "Server rendered " << _options.Width << "x" << height << " in " << renderDuration.count() << " s\n";
+		if (written)
+		{
+			std::cout << "Wrote " << _options.OutputPath << "\n";
+		}
+		return written ? 0 : 1;
+	}
+#endif
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+	const EInstructionSet instructionSet = CpuFeatures::SetInstructionSet(options.InstructionSet);
+	std::cout << "Kernels use " << CpuFeatures::GetName(instructionSet) << "\n";
+	if (options.Benchmark == "coherence")
+	{
+		CoherenceBenchmark::Run(options.Threads, options.Affinity);
+		return 0;
+	}
+	if (options.Benchmark == "vectors")
+	{
+		VectorBenchmark::Run();
+		return 0;
+	}
+#if defined(CRT_NETWORK)
+	if (!options.WorkerAddress.empty())
+	{
+		return RenderWorker::Run(options.WorkerAddress, options.Threads, options.Affinity) ? 0 : 1;
+	}
+	if (!options.CoordinatorAddress.empty())
+	{
+		return RunCoordinator(options);
+	}
+	if (!options.ServeAddress.empty())
+	{
+		RenderServer server(options.Threads, options.Affinity);
+		if (!server.Listen(options.ServeAddress))
+		{
+			return 1;
+		}
+		std::cout << "Serving renders on " << options.ServeAddress << "\n";
+		server.Run();
+		return 1;
+	}
+	if (!options.ServerAddress.empty())
+	{
+		return RunClient(options);
+	}
+#endif
+
+	Scene* scene = new Scene();
+	Timer::Duration sceneDuration;
+	{
+		Timer sceneTimer;
+		SceneLoading::BuildScene(scene, options.ScenePath);
+		sceneDuration = sceneTimer.GetDuration();
+	}
+	scene->SetPathTermination(options.PathTermination);
+	scene->SetContributionThreshold(options.ContributionThreshold);
+	scene->SetSplitDepth(options.SplitDepth);
+	scene->SetRaySorting(options.RaySorting);
+	scene->SetTraversalMode(options.TraversalMode);
+
+	Camera camera(float2(float(options.Width), float(options.Height)));
+	camera.SetPosition(options.Position);
+	camera.SetDirection(options.Direction.Normalize());
+	camera.SetFieldOfView(ToRadians(options.FieldOfView));
+	camera.SetAntiAliasing(options.Samples);
+
+	Surface surface(options.Width, options.Height);
+	Raytracer raytracer(surface, *scene, camera, options.Threads, options.Affinity);
+	raytracer.SetTileOrder(options.TileOrder);
+	raytracer.SetAdaptiveSampling(options.AdaptiveThreshold > 0.0f);
+	if (options.AdaptiveThreshold > 0.0f)
+	{
+		raytracer.SetAdaptiveThreshold(options.AdaptiveThreshold);
+	}
+	raytracer.SetDenoiseIterations(options.DenoiseIterations);
+
+	Timer renderTimer;
+	do
+	{
+		raytracer.RenderFrame();
+	} while (!raytracer.IsConverged());
+	Timer::Duration renderDuration = renderTimer.GetDuration();
+
+	std::vector<float3> image;
+	raytracer.ResolveImage(image);
+	bool written = ImageWriting::WriteImage(options.OutputPath, surface, image);
+
+	std::cout << "Scene setup: " << sceneDuration.count() << " s, " << scene->GetTriangleCount() << " triangles\n"
+		<< "Rendered " << options.Width << "x" << options.Height << " with up to " << raytracer.GetSampleCount()
+		<< " samples per pixel on " << options.Threads << " threads in " << renderDuration.count() << " s\n";
+	if (written)
+	{
+		std::cout << "Wrote " << options.OutputPath << "\n";
+	}
+
+	delete scene;
+	return written ? 0 : 1;
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 
 #include "./core/window/window.h"
 #include "./core/graphics/render_device.h"
@@ -61,7 +62,11 @@ int main(char** argc, char** argv)
 	auto initialCameraPosition = float3 { 0.0f, 0.0f, 3.0f };
 	camera.SetPosition(initialCameraPosition);
 
+	// While one surface is presented, the next frame is traced into the other
 	Surface surface(window->GetWidth(), window->GetHeight());
+	Surface backSurface(window->GetWidth(), window->GetHeight());
+	Surface* presentSurface = &surface;
+	Surface* renderSurface = &backSurface;
 	Raytracer raytracer(surface, *scene, camera);
 	RollingSampler<Timer::Duration, 20> rtFrameSampler;
 	float deltaFrameTime = 0.f;
@@ -70,20 +75,99 @@ int main(char** argc, char** argv)
 	auto previousCameraPosition = previousCameraDirection;
 	bool sceneDirty = false;
 	bool staticRenderOnly = true;
+	bool pipelinedFrames = true;
+	bool frameInFlight = false;
+	bool cancelStaleFrames = true;
+	bool droppedLastFrame = false;
 	while (!window->ShouldClose())
 	{
 		Timer frameTimer;
+		controller.ProcessInput(window->GetWindow(), deltaFrameTime);
+
+		// The scene and raytracer settings may only change while no frame is in flight
+		if (frameInFlight)
+		{
+			// Don't wait for a view that is already outdated, unless the last frame was dropped as well,
+			// so a camera that keeps moving still gets to see frames
+			bool viewChanged = previousCameraPosition != camera.GetPosition() || previousCameraDirection != camera.GetFront();
+			if (viewChanged && cancelStaleFrames && !droppedLastFrame)
+			{
+				raytracer.CancelFrame();
+			}
+			droppedLastFrame = !raytracer.WaitForFrame();
+			if (!droppedLastFrame)
+			{
+				rtFrameSampler.AddSample(raytracer.GetFrameDuration());
+				std::swap(presentSurface, renderSurface);
+			}
+			frameInFlight = false;
+		}
+
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
 
 		sceneDirty = !staticRenderOnly;
+		bool sceneChanged = false;
+		bool lightingChanged = false;
 		if (showImgui)
 		{
 			ImGui::Begin("Window", &showImgui);   // Pass a pointer to our bool variable (the window will have a closing button that will clear the bool when clicked)
 
 			ImGui::Text("RayTracer Frametime: %.3f ms", rtFrameSampler.GetAverage().count() * 1000);
 			ImGui::Separator();
+			if (ImGui::CollapsingHeader("Renderer"))
+			{
+				ERenderMode renderMode = raytracer.GetRenderMode();
+				if (ImGui::RadioButton("Tile Jobs", renderMode == ERenderMode::TileJobs))
+				{
+					raytracer.SetRenderMode(ERenderMode::TileJobs);
+				}
+				else if (ImGui::RadioButton("Persistent Workers", renderMode == ERenderMode::PersistentWorkers))
+				{
+					raytracer.SetRenderMode(ERenderMode::PersistentWorkers);
+				}
+				int tileOrder = int(raytracer.GetTileOrder());
+				if (ImGui::Combo("Tile Order", &tileOrder, "Row Major\0Morton\0Hilbert\0"))
+				{
+					raytracer.SetTileOrder(ETileOrder(tileOrder));
+				}
+				ImGui::Text("Accumulated samples: %u", raytracer.GetSampleCount());
+				ImGui::Text("Sampled tiles: %u / %u", raytracer.GetActiveTileCount(), raytracer.GetTileCount());
+
+				bool adaptiveSampling = raytracer.IsAdaptiveSamplingEnabled();
+				if (ImGui::Checkbox("Adaptive Sampling", &adaptiveSampling))
+				{
+					raytracer.SetAdaptiveSampling(adaptiveSampling);
+				}
+				float adaptiveThreshold = raytracer.GetAdaptiveThreshold();
+				if (ImGui::SliderFloat("Error threshold", &adaptiveThreshold, 0.0005f, 0.05f, "%.4f"))
+				{
+					raytracer.SetAdaptiveThreshold(adaptiveThreshold);
+				}
+
+				bool reprojection = raytracer.IsReprojectionEnabled();
+				if (ImGui::Checkbox("Temporal Reprojection", &reprojection))
+				{
+					raytracer.SetReprojection(reprojection);
+				}
+				ImGui::Text("Reprojected pixels: %u", raytracer.GetReprojectedPixelCount());
+
+				int denoiseIterations = int(raytracer.GetDenoiseIterations());
+				if (ImGui::SliderInt("Denoise iterations (0 = off)", &denoiseIterations, 0, int(Denoiser::MaxIterations)))
+				{
+					raytracer.SetDenoiseIterations(uint32_t(denoiseIterations));
+				}
+
+				ImGui::Checkbox("Pipelined Frames", &pipelinedFrames);
+				ImGui::Checkbox("Cancel Stale Frames", &cancelStaleFrames);
+
+				float frameBudget = raytracer.GetFrameBudget().count() * 1000.0f;
+				if (ImGui::SliderFloat("Frame budget (ms, 0 = off)", &frameBudget, 0.0f, 100.0f, "%.1f"))
+				{
+					raytracer.SetFrameBudget(Timer::Duration(frameBudget / 1000.0f));
+				}
+			}
 			if (ImGui::CollapsingHeader("Camera"))
 			{
 				float3 cameraPosition = camera.GetPosition();
@@ -106,6 +190,51 @@ int main(char** argc, char** argv)
 
 				ImGui::Checkbox("Static Render Only", &staticRenderOnly);
 			}
+			if (ImGui::CollapsingHeader("Lighting"))
+			{
+				std::vector<DirectionalLight>& directionalLights = scene->GetDirectionalLights();
+				for (size_t i = 0; i < directionalLights.size(); i++)
+				{
+					DirectionalLight& light = directionalLights[i];
+					ImGui::PushID(int(i));
+					ImGui::Text("Directional light %u", uint32_t(i));
+					lightingChanged |= ImGui::SliderFloat("Intensity", &light.Intensity, 0.0f, 2.0f);
+					if (ImGui::SliderFloat3("Direction", &light.Direction.x, -1.0f, 1.0f) && light.Direction.MagnitudeSquared() > 0.0f)
+					{
+						light.Direction = light.Direction.Normalize();
+						lightingChanged = true;
+					}
+					ImGui::PopID();
+				}
+			}
+			if (ImGui::CollapsingHeader("Paths"))
+			{
+				// Only the rays after the primary hits change, so these count as lighting changes
+				int pathTermination = int(scene->GetPathTermination());
+				if (ImGui::Combo("Termination", &pathTermination, "Fixed Depth\0Contribution Threshold\0Russian Roulette\0"))
+				{
+					scene->SetPathTermination(EPathTermination(pathTermination));
+					lightingChanged = true;
+				}
+				float contributionThreshold = scene->GetContributionThreshold();
+				if (ImGui::SliderFloat("Contribution threshold", &contributionThreshold, 0.001f, 0.5f, "%.3f"))
+				{
+					scene->SetContributionThreshold(contributionThreshold);
+					lightingChanged = true;
+				}
+				int splitDepth = int(std::min(scene->GetSplitDepth(), 5u));
+				if (ImGui::SliderInt("Dielectric split depth (5 = always)", &splitDepth, 0, 5))
+				{
+					scene->SetSplitDepth(splitDepth == 5 ? UINT32_MAX : uint32_t(splitDepth));
+					lightingChanged = true;
+				}
+				// Only changes the order the rays are traced in, the image stays the same
+				bool raySorting = scene->IsRaySortingEnabled();
+				if (ImGui::Checkbox("Sort secondary rays", &raySorting))
+				{
+					scene->SetRaySorting(raySorting);
+				}
+			}
 			if (ImGui::CollapsingHeader("BVH"))
 			{
 				ImGui::Text("Last BVH construction duration: %.4f s", bvhConstructionDuration.count());
@@ -114,7 +243,7 @@ int main(char** argc, char** argv)
 				bool bvh = scene->IsBVHEnabled();
 				if (ImGui::Checkbox("BVH Enabled", &bvh))
 				{
-					sceneDirty = true;
+					sceneChanged = true;
 				}
 				if (bvh)
 				{
@@ -124,29 +253,34 @@ int main(char** argc, char** argv)
 				{
 					scene->DisableBVH();
 				}
-				
+				int traversalMode = int(scene->GetTraversalMode());
+				if (ImGui::Combo("Traversal", &traversalMode, "Single Ray\0Interleaved\0Treelets\0Packets\0"))
+				{
+					scene->SetTraversalMode(ETraversalMode(traversalMode));
+				}
+
 				ImGui::Separator();
 				ImGui::Text("Debug draw setting");
 				ETraversalDebugSetting debug_setting = scene->GetBVHDebugSetting();
 				if (ImGui::RadioButton("None", debug_setting == ETraversalDebugSetting::None))
 				{
 					scene->SetBVHDebugSetting(ETraversalDebugSetting::None);
-					sceneDirty = true;
+					sceneChanged = true;
 				}
 				else if (ImGui::RadioButton("Traverse Only", debug_setting == ETraversalDebugSetting::TraversalOnly))
 				{
 					scene->SetBVHDebugSetting(ETraversalDebugSetting::TraversalOnly);
-					sceneDirty = true;
+					sceneChanged = true;
 				}
 				else if (ImGui::RadioButton("Blend", debug_setting == ETraversalDebugSetting::Blend))
 				{
 					scene->SetBVHDebugSetting(ETraversalDebugSetting::Blend);
-					sceneDirty = true;
+					sceneChanged = true;
 				}
 				else if (ImGui::RadioButton("Exclude Hits", debug_setting == ETraversalDebugSetting::ExcludeHits))
 				{
 					scene->SetBVHDebugSetting(ETraversalDebugSetting::ExcludeHits);
-					sceneDirty = true;
+					sceneChanged = true;
 				}
 			}
 			ImGui::End();
@@ -155,20 +289,38 @@ int main(char** argc, char** argv)
 		{
 			sceneDirty = true;
 		}
+		if (sceneChanged)
+		{
+			// Camera movement is picked up by the raytracer itself
+			raytracer.ResetAccumulation();
+			sceneDirty = true;
+		}
+		else if (lightingChanged)
+		{
+			// Nothing moved, so the first new sample only has to shade the primary hits again
+			raytracer.ResetLighting();
+			sceneDirty = true;
+		}
 		
-		// Only update if our view changed
-		if (sceneDirty)
+		// Only update if our view changed, or while the static view is still accumulating samples
+		if (sceneDirty || !raytracer.IsConverged())
 		{
-			Timer rtTimer;
-			raytracer.RenderFrame();
-			rtFrameSampler.AddSample(rtTimer.GetDuration());
+			raytracer.BeginFrame(*renderSurface);
+			frameInFlight = true;
 			sceneDirty = false;
+			if (!pipelinedFrames)
+			{
+				raytracer.WaitForFrame();
+				rtFrameSampler.AddSample(raytracer.GetFrameDuration());
+				std::swap(presentSurface, renderSurface);
+				frameInFlight = false;
+			}
 		}
 		previousCameraPosition = camera.GetPosition();
 		previousCameraDirection = camera.GetFront();
 
-		controller.ProcessInput(window->GetWindow(), deltaFrameTime);
-		renderDevice->CopyFrom(&surface);
+		// Presents the last finished frame while the workers trace the next one
+		renderDevice->CopyFrom(presentSurface);
 		renderDevice->Present();
 
 		ImGui::Render();
@@ -178,6 +330,7 @@ int main(char** argc, char** argv)
 		deltaFrameTime = frameTimer.GetDuration().count();
 	}
 
+	raytracer.WaitForFrame();
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
@@ -0,0 +1,36 @@
+#include "./network/render_client.h"
+#include "./network/socket.h"
+
+#include <iostream>
+
+namespace CRT
+{
+	bool RenderClient::Render(const std::string& _address, const RenderSettings& _settings, const std::string& _scenePath,
+		RegionHeader& _region, std::vector<float3>& _colors)
+	{
+		Socket socket = Socket::Connect(_address);
+		if (!socket.IsValid())
+		{
+			std::cout << "Could not connect to " << _address << "\n";
+			return false;
+		}
+
+		const MessageHeader request{ EMessageType::RenderRequest, uint32_t(sizeof(RenderSettings) + sizeof(RegionHeader) + _scenePath.size()) };
+		MessageHeader response;
+		if (!socket.SendAll(&request, sizeof(request)) || !socket.SendAll(&_settings, sizeof(_settings))
+			|| !socket.SendAll(&_region, sizeof(_region)) || !socket.SendAll(_scenePath.data(), _scenePath.size())
+			|| !socket.ReceiveAll(&response, sizeof(response)) || response.Type != EMessageType::RenderResponse)
+		{
+			std::cout << "Lost the connection to the render server\n";
+			return false;
+		}
+		if (response.Size < sizeof(RegionHeader))
+		{
+			std::cout << "The render server couldn't render " << _scenePath << "\n";
+			return false;
+		}
+
+		_colors.resize((response.Size - sizeof(RegionHeader)) / sizeof(float3));
+		return socket.ReceiveAll(&_region, sizeof(_region)) && socket.ReceiveAll(_colors.data(), _colors.size() * sizeof(float3));
+	}
+}
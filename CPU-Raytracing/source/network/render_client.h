@@ -0,0 +1,17 @@
+#pragma once
+#include "./network/render_protocol.h"
+
+#include <string>
+#include <vector>
+
+namespace CRT
+{
+	// Sends a single RenderRequest to a RenderServer
+	class RenderClient
+	{
+	public:
+		// The region is clamped to the rows the server actually rendered, the colors hold those rows
+		static bool Render(const std::string& _address, const RenderSettings& _settings, const std::string& _scenePath,
+			RegionHeader& _region, std::vector<float3>& _colors);
+	};
+}
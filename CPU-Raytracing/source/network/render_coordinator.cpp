@@ -0,0 +1,245 @@
+#include "./network/render_coordinator.h"
+#include "./raytracing/raytracer.h"
+#include "./raytracing/denoiser.h"
+#include "./benchmarking/timer.h"
+
+#include <poll.h>
+
+#include <algorithm>
+#include <iostream>
+
+namespace CRT
+{
+	RenderCoordinator::RenderCoordinator(const RenderSettings& _settings, const std::string& _scenePath) :
+		m_Settings(_settings),
+		m_ScenePath(_scenePath)
+	{
+		const uint32_t tileSize = Raytracer::GetTileSize();
+		m_RowCount = (m_Settings.Height + tileSize - 1) / tileSize;
+		m_Image.resize((uint64_t)m_Settings.Width * m_Settings.Height);
+		if (m_Settings.DenoiseIterations > 0)
+		{
+			m_Guides.resize(m_Image.size());
+		}
+
+		// Single rows keep the regions small enough to balance between uneven workers, while still giving
+		// each worker's threads a full row of tiles to share
+		for (uint32_t row = 0; row < m_RowCount; row++)
+		{
+			m_PendingRegions.push_back(RegionHeader{ row, row + 1 });
+		}
+		m_RemainingRegions = uint32_t(m_PendingRegions.size());
+	}
+
+	bool RenderCoordinator::Listen(const std::string& _address)
+	{
+		m_Listener = Socket::Listen(_address);
+		return m_Listener.IsValid();
+	}
+
+	bool RenderCoordinator::Run()
+	{
+		if (!m_Listener.IsValid())
+		{
+			return false;
+		}
+
+		std::vector<pollfd> descriptors;
+		while (m_RemainingRegions > 0)
+		{
+			descriptors.clear();
+			descriptors.push_back(pollfd{ m_Listener.GetDescriptor(), POLLIN, 0 });
+			for (const Connection& connection : m_Connections)
+			{
+				descriptors.push_back(pollfd{ connection.Socket.GetDescriptor(), POLLIN, 0 });
+			}
+			if (poll(descriptors.data(), descriptors.size(), -1) < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				std::cout << "Polling the workers failed\n";
+				return false;
+			}
+
+			// Accepting may grow the connections, only the ones that were polled are checked
+			const size_t polledCount = m_Connections.size();
+			if (descriptors[0].revents & POLLIN)
+			{
+				AcceptWorker();
+			}
+			for (size_t i = 0; i < polledCount; i++)
+			{
+				if ((descriptors[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) && !ReceiveResult(m_Connections[i]))
+				{
+					Disconnect(m_Connections[i]);
+				}
+			}
+			m_Connections.erase(std::remove_if(m_Connections.begin(), m_Connections.end(),
+				[](const Connection& _connection) { return !_connection.Socket.IsValid(); }), m_Connections.end());
+
+			// Regions of lost workers go to the ones that ran out of work
+			for (Connection& connection : m_Connections)
+			{
+				if (!connection.Region)
+				{
+					AssignRegion(connection);
+				}
+			}
+		}
+
+		const MessageHeader finished{ EMessageType::Finished, 0 };
+		for (const Connection& connection : m_Connections)
+		{
+			connection.Socket.SendAll(&finished, sizeof(finished));
+		}
+		m_Connections.clear();
+
+		if (m_Settings.DenoiseIterations > 0)
+		{
+			if (m_GuidesComplete)
+			{
+				DenoiseImage();
+			}
+			else
+			{
+				std::cout << "Workers sent no guides for the denoiser, the image is left unfiltered\n";
+			}
+		}
+		return true;
+	}
+
+	const std::vector<float3>& RenderCoordinator::GetImage() const
+	{
+		return m_Image;
+	}
+
+	uint32_t RenderCoordinator::GetWorkerCount() const
+	{
+		return m_WorkerCount;
+	}
+
+	void RenderCoordinator::AcceptWorker()
+	{
+		Connection connection;
+		connection.Socket = m_Listener.Accept();
+		if (!connection.Socket.IsValid() || !SendSetup(connection))
+		{
+			return;
+		}
+		m_WorkerCount++;
+		std::cout << "Worker " << m_WorkerCount << " connected, " << m_RemainingRegions << " regions left\n";
+		AssignRegion(connection);
+		if (connection.Socket.IsValid())
+		{
+			m_Connections.push_back(std::move(connection));
+		}
+	}
+
+	bool RenderCoordinator::SendSetup(const Connection& _connection) const
+	{
+		const MessageHeader header{ EMessageType::Setup, uint32_t(sizeof(RenderSettings) + m_ScenePath.size()) };
+		return _connection.Socket.SendAll(&header, sizeof(header))
+			&& _connection.Socket.SendAll(&m_Settings, sizeof(m_Settings))
+			&& _connection.Socket.SendAll(m_ScenePath.data(), m_ScenePath.size());
+	}
+
+	void RenderCoordinator::AssignRegion(Connection& _connection)
+	{
+		if (m_PendingRegions.empty())
+		{
+			return;
+		}
+		const RegionHeader region = m_PendingRegions.front();
+		m_PendingRegions.pop_front();
+		_connection.Region = region;
+
+		const MessageHeader header{ EMessageType::Region, sizeof(RegionHeader) };
+		if (!_connection.Socket.SendAll(&header, sizeof(header)) || !_connection.Socket.SendAll(&region, sizeof(region)))
+		{
+			Disconnect(_connection);
+		}
+	}
+
+	bool RenderCoordinator::ReceiveResult(Connection& _connection)
+	{
+		MessageHeader header;
+		RegionHeader region;
+		if (!_connection.Socket.ReceiveAll(&header, sizeof(header)) || header.Type != EMessageType::RegionResult
+			|| !_connection.Region || header.Size < sizeof(RegionHeader)
+			|| !_connection.Socket.ReceiveAll(&region, sizeof(region)))
+		{
+			return false;
+		}
+
+		const uint32_t tileSize = Raytracer::GetTileSize();
+		const uint32_t yBegin = region.RowBegin * tileSize;
+		const uint32_t yEnd = std::min(region.RowEnd * tileSize, m_Settings.Height);
+		const uint64_t pixelCount = (uint64_t)(yEnd - yBegin) * m_Settings.Width;
+		const uint64_t colorSize = sizeof(RegionHeader) + pixelCount * sizeof(float3);
+		const bool hasGuides = !m_Guides.empty() && header.Size == colorSize + pixelCount * sizeof(Denoiser::Guide);
+		if (region.RowBegin != _connection.Region->RowBegin || region.RowEnd != _connection.Region->RowEnd
+			|| (header.Size != colorSize && !hasGuides))
+		{
+			std::cout << "Worker returned a region it wasn't asked for\n";
+			return false;
+		}
+		const uint64_t offset = (uint64_t)yBegin * m_Settings.Width;
+		if (!_connection.Socket.ReceiveAll(&m_Image[offset], pixelCount * sizeof(float3))
+			|| (hasGuides && !_connection.Socket.ReceiveAll(&m_Guides[offset], pixelCount * sizeof(Denoiser::Guide))))
+		{
+			return false;
+		}
+		m_GuidesComplete = m_GuidesComplete && hasGuides;
+
+		_connection.Region.reset();
+		m_RemainingRegions--;
+		AssignRegion(_connection);
+		return true;
+	}
+
+	void RenderCoordinator::DenoiseImage()
+	{
+		Timer denoiseTimer;
+		const uint32_t width = m_Settings.Width;
+		const uint32_t height = m_Settings.Height;
+		const uint32_t iterations = std::min(m_Settings.DenoiseIterations, Denoiser::MaxIterations);
+		Denoiser denoiser(width, height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const uint64_t pixel = x + (uint64_t)y * width;
+				denoiser.SetPixel(x, y, m_Image[pixel], m_Guides[pixel]);
+			}
+		}
+		for (uint32_t iteration = 0; iteration < iterations; iteration++)
+		{
+			denoiser.Filter(iteration, 0, 0, width, height);
+		}
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				m_Image[x + (uint64_t)y * width] = denoiser.GetResult(iterations, x, y);
+			}
+		}
+		std::cout << "Denoised the image in " << denoiseTimer.GetDuration().count() << " s\n";
+	}
+
+	void RenderCoordinator::Disconnect(Connection& _connection)
+	{
+		if (_connection.Region)
+		{
+			// Someone else renders it, a partially received result gets overwritten
+			m_PendingRegions.push_front(*_connection.Region);
+			_connection.Region.reset();
+		}
+		if (_connection.Socket.IsValid())
+		{
+			std::cout << "Worker disconnected, " << m_RemainingRegions << " regions left\n";
+		}
+		_connection.Socket.Close();
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "./network/socket.h"
+#include "./network/render_protocol.h"
+
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace CRT
+{
+	// Splits a render into regions of tile rows and hands them to worker processes connecting over a socket.
+	// Every worker has a single region outstanding and gets the next one when it returns its result, so
+	// faster machines simply take more rows. Workers can join at any time, and the region of a worker that
+	// disconnects goes back into the queue
+	class RenderCoordinator
+	{
+	public:
+		RenderCoordinator(const RenderSettings& _settings, const std::string& _scenePath);
+
+		bool Listen(const std::string& _address);
+		// Blocks until every region has been rendered, and filters the assembled image when denoising
+		bool Run();
+
+		// Resolved colors of the whole image, row by row
+		const std::vector<float3>& GetImage() const;
+		uint32_t GetWorkerCount() const;
+
+	private:
+		struct Connection
+		{
+			CRT::Socket Socket;
+			std::optional<RegionHeader> Region;
+		};
+
+		void AcceptWorker();
+		bool SendSetup(const Connection& _connection) const;
+		void AssignRegion(Connection& _connection);
+		bool ReceiveResult(Connection& _connection);
+		void Disconnect(Connection& _connection);
+		// Filters the whole image at once, like a single render does, so regions don't show seams at their edges
+		void DenoiseImage();
+
+		RenderSettings m_Settings;
+		std::string m_ScenePath;
+		uint32_t m_RowCount = 0;
+
+		Socket m_Listener;
+		std::vector<Connection> m_Connections;
+		std::deque<RegionHeader> m_PendingRegions;
+		uint32_t m_RemainingRegions = 0;
+		uint32_t m_WorkerCount = 0;
+
+		std::vector<float3> m_Image;
+		std::vector<Denoiser::Guide> m_Guides;
+		// Every region came with its guides, workers that don't know their primary hits send none
+		bool m_GuidesComplete = true;
+	};
+}
@@ -0,0 +1,40 @@
+#include "./network/render_protocol.h"
+#include "./core/math/trigonometry.h"
+
+namespace CRT
+{
+	void ApplyRenderSettings(const RenderSettings& _settings, Scene& _scene, Camera& _camera, Raytracer& _raytracer)
+	{
+		_camera.SetPosition(_settings.Position);
+		_camera.SetDirection(_settings.Direction.Normalize());
+		_camera.SetFieldOfView(ToRadians(_settings.FieldOfView));
+		_camera.SetAntiAliasing(_settings.Samples);
+
+		_raytracer.SetAdaptiveSampling(_settings.AdaptiveThreshold > 0.0f);
+		if (_settings.AdaptiveThreshold > 0.0f)
+		{
+			_raytracer.SetAdaptiveThreshold(_settings.AdaptiveThreshold);
+		}
+		// A server filters the region it was asked for on its own, its edges only see the rows of that region.
+		// Workers turn it off again and leave the filtering to the coordinator
+		_raytracer.SetDenoiseIterations(_settings.DenoiseIterations);
+
+		_scene.SetPathTermination(_settings.PathTermination);
+		_scene.SetContributionThreshold(_settings.ContributionThreshold);
+		_scene.SetSplitDepth(_settings.SplitDepth);
+	}
+
+	void RenderRegion(const RegionHeader& _region, Raytracer& _raytracer, std::vector<float3>& _colors)
+	{
+		// Every region starts from scratch, so it's sampled exactly like it would be in a single render
+		_raytracer.ResetAccumulation();
+		_raytracer.SetTileRows(_region.RowBegin, _region.RowEnd);
+		do
+		{
+			_raytracer.RenderFrame();
+		} while (!_raytracer.IsConverged());
+
+		const uint32_t tileSize = Raytracer::GetTileSize();
+		_raytracer.ResolveImage(_colors, _region.RowBegin * tileSize, _region.RowEnd * tileSize);
+	}
+}
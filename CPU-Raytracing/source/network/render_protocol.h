@@ -0,0 +1,65 @@
+#pragma once
+#include "./core/math/float3.h"
+#include "./raytracing/camera.h"
+#include "./raytracing/raytracer.h"
+#include "./raytracing/scene.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace CRT
+{
+	// Messages between the render coordinator and its workers. Every message is a header followed by
+	// Size bytes of payload. Both ends run the same build, so payloads are sent in memory layout
+	enum class EMessageType : uint32_t
+	{
+		// Coordinator to worker: RenderSettings followed by the scene path
+		Setup,
+		// Coordinator to worker: a RegionHeader, render those tile rows
+		Region,
+		// Worker to coordinator: a RegionHeader followed by the resolved colors of its rows. When denoising, the
+		// denoiser's guides of the rows follow, so the coordinator can filter the assembled image
+		RegionResult,
+		// Coordinator to worker: everything is rendered, disconnect
+		Finished,
+		// Client to server: RenderSettings and a RegionHeader followed by the scene path
+		RenderRequest,
+		// Server to client: a RegionHeader followed by the resolved colors of its rows, without any payload
+		// when the request couldn't be rendered
+		RenderResponse
+	};
+
+	struct MessageHeader
+	{
+		EMessageType Type;
+		uint32_t Size;
+	};
+
+	struct RenderSettings
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t Samples;
+		float FieldOfView;
+		float AdaptiveThreshold;
+		uint32_t DenoiseIterations;
+		EPathTermination PathTermination;
+		float ContributionThreshold;
+		uint32_t SplitDepth;
+		float3 Position;
+		float3 Direction;
+	};
+
+	// A region is a range of tile rows, in tiles of Raytracer::GetTileSize() pixels
+	struct RegionHeader
+	{
+		uint32_t RowBegin;
+		uint32_t RowEnd;
+	};
+
+	// Points the camera and sets the sampling of the raytracer and the scene, the camera's resolution has to
+	// match already
+	void ApplyRenderSettings(const RenderSettings& _settings, Scene& _scene, Camera& _camera, Raytracer& _raytracer);
+	// Samples the tile rows of the region from scratch until they converge and resolves their colors
+	void RenderRegion(const RegionHeader& _region, Raytracer& _raytracer, std::vector<float3>& _colors);
+}
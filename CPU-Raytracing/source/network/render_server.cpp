@@ -0,0 +1,173 @@
+#include "./network/render_server.h"
+
+#include "./core/graphics/screen/surface.h"
+#include "./scene/scene_loading.h"
+#include "./benchmarking/timer.h"
+
+#include <poll.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <new>
+
+namespace CRT
+{
+	namespace
+	{
+		// Anything longer isn't a path, don't allocate whatever a broken client claims
+		const uint32_t MaxScenePathLength = 4096;
+		// Per side, well above any display. The buffers of a frame take hundreds of bytes per pixel, a broken
+		// client shouldn't get the daemon to try and allocate terabytes
+		const uint32_t MaxResolution = 16384;
+	}
+
+	RenderServer::RenderServer(int _threadCount, EThreadAffinity _affinity) :
+		m_ThreadCount(_threadCount),
+		m_Affinity(_affinity)
+	{
+	}
+
+	bool RenderServer::Listen(const std::string& _address)
+	{
+		m_Listener = Socket::Listen(_address);
+		return m_Listener.IsValid();
+	}
+
+	void RenderServer::Run()
+	{
+		std::vector<pollfd> descriptors;
+		while (m_Listener.IsValid())
+		{
+			descriptors.clear();
+			descriptors.push_back(pollfd{ m_Listener.GetDescriptor(), POLLIN, 0 });
+			for (const Socket& client : m_Clients)
+			{
+				descriptors.push_back(pollfd{ client.GetDescriptor(), POLLIN, 0 });
+			}
+			if (poll(descriptors.data(), descriptors.size(), -1) < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				std::cout << "Polling the clients failed\n";
+				return;
+			}
+
+			const size_t polledCount = m_Clients.size();
+			if (descriptors[0].revents & POLLIN)
+			{
+				Socket client = m_Listener.Accept();
+				if (client.IsValid())
+				{
+					m_Clients.push_back(std::move(client));
+				}
+			}
+			for (size_t i = 0; i < polledCount; i++)
+			{
+				if ((descriptors[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) && !Serve(m_Clients[i]))
+				{
+					m_Clients[i].Close();
+				}
+			}
+			m_Clients.erase(std::remove_if(m_Clients.begin(), m_Clients.end(),
+				[](const Socket& _client) { return !_client.IsValid(); }), m_Clients.end());
+		}
+	}
+
+	bool RenderServer::Serve(const Socket& _client)
+	{
+		MessageHeader header;
+		RenderSettings settings;
+		RegionHeader region;
+		const uint32_t fixedSize = sizeof(RenderSettings) + sizeof(RegionHeader);
+		if (!_client.ReceiveAll(&header, sizeof(header)) || header.Type != EMessageType::RenderRequest
+			|| header.Size < fixedSize || header.Size - fixedSize > MaxScenePathLength
+			|| !_client.ReceiveAll(&settings, sizeof(settings)) || !_client.ReceiveAll(&region, sizeof(region)))
+		{
+			return false;
+		}
+		std::string scenePath(header.Size - fixedSize, '\0');
+		if (!_client.ReceiveAll(&scenePath[0], scenePath.size()))
+		{
+			return false;
+		}
+
+		Scene* scene = nullptr;
+		if (settings.Width > 0 && settings.Height > 0 && settings.Width <= MaxResolution && settings.Height <= MaxResolution
+			&& settings.Samples > 0 && region.RowBegin < region.RowEnd)
+		{
+			scene = GetScene(scenePath);
+		}
+		const MessageHeader failed{ EMessageType::RenderResponse, 0 };
+		if (scene == nullptr)
+		{
+			return _client.SendAll(&failed, sizeof(failed));
+		}
+
+		Timer renderTimer;
+		try
+		{
+			Raytracer& raytracer = GetRaytracer(*scene, settings);
+			ApplyRenderSettings(settings, *scene, *m_Camera, raytracer);
+			region.RowEnd = std::min(region.RowEnd, raytracer.GetTileRowCount());
+			RenderRegion(region, raytracer, m_Colors);
+		}
+		catch (const std::bad_alloc&)
+		{
+			// Even a capped resolution can be more than this machine holds, the server keeps serving smaller ones
+			std::cout << "Not enough memory to render " << scenePath << " at " << settings.Width << "x"
+				<< settings.Height << std::endl;
+			m_Raytracer.reset();
+			m_Surface.reset();
+			m_Camera.reset();
+			m_RaytracerScene = nullptr;
+			std::vector<float3>().swap(m_Colors);
+			return _client.SendAll(&failed, sizeof(failed));
+		}
+		std::cout << "Rendered " << scenePath << " at " << settings.Width << "x" << settings.Height << " in "
+			<< renderTimer.GetDuration().count() << " s" << std::endl;
+
+		const MessageHeader response{ EMessageType::RenderResponse, uint32_t(sizeof(RegionHeader) + m_Colors.size() * sizeof(float3)) };
+		return _client.SendAll(&response, sizeof(response)) && _client.SendAll(&region, sizeof(region))
+			&& _client.SendAll(m_Colors.data(), m_Colors.size() * sizeof(float3));
+	}
+
+	Scene* RenderServer::GetScene(const std::string& _scenePath)
+	{
+		auto found = m_Scenes.find(_scenePath);
+		if (found != m_Scenes.end())
+		{
+			return found->second.get();
+		}
+		// The loaders only report failures on the console, so catch the common one before caching an empty scene
+		if (!SceneLoading::IsBuiltin(_scenePath) && !std::ifstream(_scenePath))
+		{
+			std::cout << "Could not open scene " << _scenePath << std::endl;
+			return nullptr;
+		}
+
+		Timer loadTimer;
+		std::unique_ptr<Scene> scene = std::make_unique<Scene>();
+		SceneLoading::BuildScene(scene.get(), _scenePath);
+		std::cout << "Loaded " << _scenePath << " in " << loadTimer.GetDuration().count() << " s, "
+			<< scene->GetTriangleCount() << " triangles" << std::endl;
+		return m_Scenes.emplace(_scenePath, std::move(scene)).first->second.get();
+	}
+
+	Raytracer& RenderServer::GetRaytracer(const Scene& _scene, const RenderSettings& _settings)
+	{
+		// Accumulation buffers and threads are sized for a scene and resolution, anything else is per request
+		if (m_Raytracer == nullptr || m_RaytracerScene != &_scene
+			|| m_Surface->GetWidth() != _settings.Width || m_Surface->GetHeight() != _settings.Height)
+		{
+			m_Raytracer.reset();
+			m_Camera = std::make_unique<Camera>(float2(float(_settings.Width), float(_settings.Height)));
+			m_Surface = std::make_unique<Surface>(_settings.Width, _settings.Height);
+			m_Raytracer = std::make_unique<Raytracer>(*m_Surface, _scene, *m_Camera, m_ThreadCount, m_Affinity);
+			m_RaytracerScene = &_scene;
+		}
+		return *m_Raytracer;
+	}
+}
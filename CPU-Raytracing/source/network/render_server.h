@@ -0,0 +1,43 @@
+#pragma once
+#include "./network/socket.h"
+#include "./network/render_protocol.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace CRT
+{
+	// Long running renderer that answers RenderRequests over a socket. Scenes stay loaded after their first
+	// request, including their BVHs and textures, and the raytracer with its threads is kept as long as the
+	// scene and resolution don't change, so a request only pays for tracing its image. Log lines are flushed right
+	// away since the server usually runs with its output going to a file
+	class RenderServer
+	{
+	public:
+		RenderServer(int _threadCount, EThreadAffinity _affinity);
+
+		bool Listen(const std::string& _address);
+		// Serves clients until the listening socket fails, one request at a time
+		void Run();
+
+	private:
+		// Returns false when the client went away or sent something that isn't a request
+		bool Serve(const Socket& _client);
+		Scene* GetScene(const std::string& _scenePath);
+		Raytracer& GetRaytracer(const Scene& _scene, const RenderSettings& _settings);
+
+		int m_ThreadCount;
+		EThreadAffinity m_Affinity;
+		Socket m_Listener;
+		std::vector<Socket> m_Clients;
+		std::unordered_map<std::string, std::unique_ptr<Scene>> m_Scenes;
+
+		const Scene* m_RaytracerScene = nullptr;
+		std::unique_ptr<Camera> m_Camera;
+		std::unique_ptr<Surface> m_Surface;
+		std::unique_ptr<Raytracer> m_Raytracer;
+		std::vector<float3> m_Colors;
+	};
+}
@@ -0,0 +1,99 @@
+#include "./network/render_worker.h"
+#include "./network/render_protocol.h"
+#include "./network/socket.h"
+
+#include "./core/graphics/screen/surface.h"
+#include "./scene/scene_loading.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace CRT
+{
+	namespace
+	{
+		// Spawned workers can start before the coordinator is listening on a remote machine
+		const int ConnectAttempts = 50;
+		const std::chrono::milliseconds ConnectRetryDelay(100);
+	}
+
+	bool RenderWorker::Run(const std::string& _address, int _threadCount, EThreadAffinity _affinity)
+	{
+		Socket socket;
+		for (int attempt = 0; attempt < ConnectAttempts && !socket.IsValid(); attempt++)
+		{
+			socket = Socket::Connect(_address);
+			if (!socket.IsValid())
+			{
+				std::this_thread::sleep_for(ConnectRetryDelay);
+			}
+		}
+		if (!socket.IsValid())
+		{
+			std::cout << "Could not connect to " << _address << "\n";
+			return false;
+		}
+
+		MessageHeader header;
+		RenderSettings settings;
+		if (!socket.ReceiveAll(&header, sizeof(header)) || header.Type != EMessageType::Setup || header.Size < sizeof(RenderSettings)
+			|| !socket.ReceiveAll(&settings, sizeof(settings)))
+		{
+			std::cout << "Did not receive the render settings\n";
+			return false;
+		}
+		std::string scenePath(header.Size - sizeof(RenderSettings), '\0');
+		if (!socket.ReceiveAll(&scenePath[0], scenePath.size()))
+		{
+			return false;
+		}
+
+		std::unique_ptr<Scene> scene = std::make_unique<Scene>();
+		SceneLoading::BuildScene(scene.get(), scenePath);
+
+		Camera camera(float2(float(settings.Width), float(settings.Height)));
+		Surface surface(settings.Width, settings.Height);
+		Raytracer raytracer(surface, *scene, camera, _threadCount, _affinity);
+		ApplyRenderSettings(settings, *scene, camera, raytracer);
+		// A region filtered on its own would show seams at its edges, the coordinator filters the assembled image
+		raytracer.SetDenoiseIterations(0);
+
+		std::vector<float3> colors;
+		std::vector<Denoiser::Guide> guides;
+		while (socket.ReceiveAll(&header, sizeof(header)))
+		{
+			if (header.Type == EMessageType::Finished)
+			{
+				return true;
+			}
+			RegionHeader region;
+			if (header.Type != EMessageType::Region || header.Size != sizeof(RegionHeader) || !socket.ReceiveAll(&region, sizeof(region)))
+			{
+				std::cout << "Unexpected message from the coordinator\n";
+				return false;
+			}
+
+			RenderRegion(region, raytracer, colors);
+			const uint32_t tileSize = Raytracer::GetTileSize();
+			guides.clear();
+			if (settings.DenoiseIterations > 0 && !raytracer.ResolveDenoiseGuides(guides, region.RowBegin * tileSize, region.RowEnd * tileSize))
+			{
+				// Without the primary hits the coordinator leaves the image unfiltered
+				guides.clear();
+			}
+			const MessageHeader result{ EMessageType::RegionResult,
+				uint32_t(sizeof(RegionHeader) + colors.size() * sizeof(float3) + guides.size() * sizeof(Denoiser::Guide)) };
+			if (!socket.SendAll(&result, sizeof(result)) || !socket.SendAll(&region, sizeof(region))
+				|| !socket.SendAll(colors.data(), colors.size() * sizeof(float3))
+				|| !socket.SendAll(guides.data(), guides.size() * sizeof(Denoiser::Guide)))
+			{
+				break;
+			}
+		}
+		std::cout << "Lost the connection to the coordinator\n";
+		return false;
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "./core/job_manager.h"
+
+#include <string>
+
+namespace CRT
+{
+	// Connects to a RenderCoordinator and renders the regions it hands out until it is told to stop
+	class RenderWorker
+	{
+	public:
+		// Returns false when the connection failed or was lost before the coordinator finished
+		static bool Run(const std::string& _address, int _threadCount, EThreadAffinity _affinity);
+	};
+}
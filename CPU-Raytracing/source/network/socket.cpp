@@ -0,0 +1,239 @@
+#include "./network/socket.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+namespace CRT
+{
+	namespace
+	{
+		const std::string UnixPrefix = "unix:";
+
+		bool IsUnixAddress(const std::string& _address)
+		{
+			return _address.compare(0, UnixPrefix.size(), UnixPrefix) == 0;
+		}
+
+		bool FillUnixAddress(const std::string& _address, sockaddr_un& _result)
+		{
+			const std::string path = _address.substr(UnixPrefix.size());
+			if (path.size() >= sizeof(_result.sun_path))
+			{
+				std::cout << "Socket path too long: " << path << "\n";
+				return false;
+			}
+			std::memset(&_result, 0, sizeof(_result));
+			_result.sun_family = AF_UNIX;
+			std::memcpy(_result.sun_path, path.c_str(), path.size() + 1);
+			return true;
+		}
+
+		addrinfo* ResolveTCPAddress(const std::string& _address, bool _passive)
+		{
+			const size_t colon = _address.find_last_of(':');
+			if (colon == std::string::npos)
+			{
+				std::cout << "Address needs a port: " << _address << "\n";
+				return nullptr;
+			}
+			const std::string host = _address.substr(0, colon);
+			const std::string port = _address.substr(colon + 1);
+
+			addrinfo hints;
+			std::memset(&hints, 0, sizeof(hints));
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			hints.ai_flags = _passive ? AI_PASSIVE : 0;
+			addrinfo* result = nullptr;
+			if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0)
+			{
+				std::cout << "Could not resolve " << _address << "\n";
+				return nullptr;
+			}
+			return result;
+		}
+
+		void DisableNagle(int _descriptor)
+		{
+			// Requests are small and answered right away, don't let them wait for more data
+			int enabled = 1;
+			setsockopt(_descriptor, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+		}
+	}
+
+	Socket::Socket(int _descriptor) :
+		m_Descriptor(_descriptor)
+	{
+	}
+
+	Socket::~Socket()
+	{
+		Close();
+	}
+
+	Socket::Socket(Socket&& _other) noexcept :
+		m_Descriptor(_other.m_Descriptor)
+	{
+		_other.m_Descriptor = -1;
+	}
+
+	Socket& Socket::operator=(Socket&& _other) noexcept
+	{
+		if (this != &_other)
+		{
+			Close();
+			m_Descriptor = _other.m_Descriptor;
+			_other.m_Descriptor = -1;
+		}
+		return *this;
+	}
+
+	Socket Socket::Listen(const std::string& _address)
+	{
+		if (IsUnixAddress(_address))
+		{
+			sockaddr_un address;
+			if (!FillUnixAddress(_address, address))
+			{
+				return Socket();
+			}
+			Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+			// A previous run might have left its socket file behind
+			unlink(address.sun_path);
+			if (!socket.IsValid() || bind(socket.m_Descriptor, (sockaddr*)&address, sizeof(address)) != 0
+				|| listen(socket.m_Descriptor, SOMAXCONN) != 0)
+			{
+				std::cout << "Could not listen on " << _address << ": " << std::strerror(errno) << "\n";
+				return Socket();
+			}
+			return socket;
+		}
+
+		addrinfo* addresses = ResolveTCPAddress(_address, true);
+		for (addrinfo* info = addresses; info != nullptr; info = info->ai_next)
+		{
+			Socket socket(::socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+			if (!socket.IsValid())
+			{
+				continue;
+			}
+			int reuse = 1;
+			setsockopt(socket.m_Descriptor, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+			if (bind(socket.m_Descriptor, info->ai_addr, info->ai_addrlen) == 0 && listen(socket.m_Descriptor, SOMAXCONN) == 0)
+			{
+				freeaddrinfo(addresses);
+				return socket;
+			}
+		}
+		if (addresses != nullptr)
+		{
+			freeaddrinfo(addresses);
+		}
+		std::cout << "Could not listen on " << _address << ": " << std::strerror(errno) << "\n";
+		return Socket();
+	}
+
+	Socket Socket::Connect(const std::string& _address)
+	{
+		if (IsUnixAddress(_address))
+		{
+			sockaddr_un address;
+			if (!FillUnixAddress(_address, address))
+			{
+				return Socket();
+			}
+			Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+			if (!socket.IsValid() || connect(socket.m_Descriptor, (sockaddr*)&address, sizeof(address)) != 0)
+			{
+				return Socket();
+			}
+			return socket;
+		}
+
+		addrinfo* addresses = ResolveTCPAddress(_address, false);
+		for (addrinfo* info = addresses; info != nullptr; info = info->ai_next)
+		{
+			Socket socket(::socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+			if (socket.IsValid() && connect(socket.m_Descriptor, info->ai_addr, info->ai_addrlen) == 0)
+			{
+				freeaddrinfo(addresses);
+				DisableNagle(socket.m_Descriptor);
+				return socket;
+			}
+		}
+		if (addresses != nullptr)
+		{
+			freeaddrinfo(addresses);
+		}
+		return Socket();
+	}
+
+	Socket Socket::Accept() const
+	{
+		Socket socket(accept(m_Descriptor, nullptr, nullptr));
+		sockaddr_storage address;
+		socklen_t length = sizeof(address);
+		if (socket.IsValid() && getsockname(socket.m_Descriptor, (sockaddr*)&address, &length) == 0 && address.ss_family != AF_UNIX)
+		{
+			DisableNagle(socket.m_Descriptor);
+		}
+		return socket;
+	}
+
+	bool Socket::SendAll(const void* _data, size_t _size) const
+	{
+		const char* data = static_cast<const char*>(_data);
+		while (_size > 0)
+		{
+			// A peer that closed its end must show up as a failed send, not as SIGPIPE
+			const ssize_t sent = send(m_Descriptor, data, _size, MSG_NOSIGNAL);
+			if (sent <= 0)
+			{
+				if (sent < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				return false;
+			}
+			data += sent;
+			_size -= size_t(sent);
+		}
+		return true;
+	}
+
+	bool Socket::ReceiveAll(void* _data, size_t _size) const
+	{
+		char* data = static_cast<char*>(_data);
+		while (_size > 0)
+		{
+			const ssize_t received = recv(m_Descriptor, data, _size, 0);
+			if (received <= 0)
+			{
+				if (received < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				return false;
+			}
+			data += received;
+			_size -= size_t(received);
+		}
+		return true;
+	}
+
+	void Socket::Close()
+	{
+		if (m_Descriptor >= 0)
+		{
+			close(m_Descriptor);
+			m_Descriptor = -1;
+		}
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace CRT
+{
+	// Blocking stream socket over POSIX sockets. Addresses are either "unix:<path>" for a Unix domain socket
+	// or "<host>:<port>" for TCP. Failures are reported through the return values, a peer that went away
+	// shouldn't take the process down with it
+	class Socket
+	{
+	public:
+		Socket() = default;
+		explicit Socket(int _descriptor);
+		~Socket();
+
+		Socket(Socket&& _other) noexcept;
+		Socket& operator=(Socket&& _other) noexcept;
+		Socket(const Socket&) = delete;
+		Socket& operator=(const Socket&) = delete;
+
+		static Socket Listen(const std::string& _address);
+		static Socket Connect(const std::string& _address);
+		Socket Accept() const;
+
+		bool SendAll(const void* _data, size_t _size) const;
+		bool ReceiveAll(void* _data, size_t _size) const;
+
+		bool IsValid() const { return m_Descriptor >= 0; }
+		int GetDescriptor() const { return m_Descriptor; }
+		void Close();
+
+	private:
+		int m_Descriptor = -1;
+	};
+}
@@ -1,20 +1,158 @@
 #include "bvh.h"
+#include "./core/numa_topology.h"
 
+#include <immintrin.h>
 #include <algorithm>
+#include <cfloat>
 #include <memory>
 #include <array>
+#include <deque>
+#include <stdexcept>
 
 namespace CRT
 {
+	namespace
+	{
+		// Node of a packet traversal, with the lanes whose rays hit it
+		struct PacketNode
+		{
+			const BVHNode* Node;
+			uint32_t Lanes;
+		};
+
+		// Slab test of every lane, against the nearest hit the lane found so far. Returns all bits set in the
+		// lanes that hit the bounds, and where each lane enters them
+		CRT_TARGET_AVX2 inline __m256 IntersectBounds(const AABB& _bounds, const RayLanes8& _rays, __m256 _t, __m256& _near)
+		{
+			const __m256 x0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_bounds.Min.x), _rays.Ox), _rays.rDx);
+			const __m256 x1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_bounds.Max.x), _rays.Ox), _rays.rDx);
+			const __m256 y0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_bounds.Min.y), _rays.Oy), _rays.rDy);
+			const __m256 y1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_bounds.Max.y), _rays.Oy), _rays.rDy);
+			const __m256 z0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_bounds.Min.z), _rays.Oz), _rays.rDz);
+			const __m256 z1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_bounds.Max.z), _rays.Oz), _rays.rDz);
+			_near = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(x0, x1), _mm256_min_ps(y0, y1)), _mm256_min_ps(z0, z1));
+			const __m256 far = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(x0, x1), _mm256_max_ps(y0, y1)), _mm256_max_ps(z0, z1));
+			return _mm256_and_ps(_mm256_cmp_ps(far, _mm256_max_ps(_near, _mm256_setzero_ps()), _CMP_GE_OQ),
+				_mm256_cmp_ps(_near, _t, _CMP_LT_OQ));
+		}
+
+		CRT_TARGET_AVX512 inline __mmask16 IntersectBounds(const AABB& _bounds, const RayLanes16& _rays, __mmask16 _lanes, __m512 _t, __m512& _near)
+		{
+			const __m512 x0 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(_bounds.Min.x), _rays.Ox), _rays.rDx);
+			const __m512 x1 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(_bounds.Max.x), _rays.Ox), _rays.rDx);
+			const __m512 y0 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(_bounds.Min.y), _rays.Oy), _rays.rDy);
+			const __m512 y1 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(_bounds.Max.y), _rays.Oy), _rays.rDy);
+			const __m512 z0 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(_bounds.Min.z), _rays.Oz), _rays.rDz);
+			const __m512 z1 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(_bounds.Max.z), _rays.Oz), _rays.rDz);
+			_near = _mm512_max_ps(_mm512_max_ps(_mm512_min_ps(x0, x1), _mm512_min_ps(y0, y1)), _mm512_min_ps(z0, z1));
+			const __m512 far = _mm512_min_ps(_mm512_min_ps(_mm512_max_ps(x0, x1), _mm512_max_ps(y0, y1)), _mm512_max_ps(z0, z1));
+			const __mmask16 entered = _mm512_mask_cmp_ps_mask(_lanes, far, _mm512_max_ps(_near, _mm512_setzero_ps()), _CMP_GE_OQ);
+			return _mm512_mask_cmp_ps_mask(entered, _near, _t, _CMP_LT_OQ);
+		}
+
+		// Möller-Trumbore like Triangle::Intersect, for the given lanes. Lanes that hit the triangle nearer than
+		// before take its distance and index
+		CRT_TARGET_AVX2 inline void IntersectTriangle(const Triangle& _triangle, uint32_t _index, const RayLanes8& _rays,
+			__m256 _lanes, __m256& _t, __m256i& _primitives)
+		{
+			const float3 edge1 = _triangle.V1 - _triangle.V0;
+			const float3 edge2 = _triangle.V2 - _triangle.V0;
+			const __m256 e1x = _mm256_set1_ps(edge1.x), e1y = _mm256_set1_ps(edge1.y), e1z = _mm256_set1_ps(edge1.z);
+			const __m256 e2x = _mm256_set1_ps(edge2.x), e2y = _mm256_set1_ps(edge2.y), e2z = _mm256_set1_ps(edge2.z);
+
+			const __m256 px = _mm256_fmsub_ps(_rays.Dy, e2z, _mm256_mul_ps(_rays.Dz, e2y));
+			const __m256 py = _mm256_fmsub_ps(_rays.Dz, e2x, _mm256_mul_ps(_rays.Dx, e2z));
+			const __m256 pz = _mm256_fmsub_ps(_rays.Dx, e2y, _mm256_mul_ps(_rays.Dy, e2x));
+			const __m256 determinant = _mm256_fmadd_ps(e1z, pz, _mm256_fmadd_ps(e1y, py, _mm256_mul_ps(e1x, px)));
+			const __m256 inverseDeterminant = _mm256_div_ps(_mm256_set1_ps(1.0f), determinant);
+
+			const __m256 tx = _mm256_sub_ps(_rays.Ox, _mm256_set1_ps(_triangle.V0.x));
+			const __m256 ty = _mm256_sub_ps(_rays.Oy, _mm256_set1_ps(_triangle.V0.y));
+			const __m256 tz = _mm256_sub_ps(_rays.Oz, _mm256_set1_ps(_triangle.V0.z));
+			const __m256 u = _mm256_mul_ps(_mm256_fmadd_ps(tz, pz, _mm256_fmadd_ps(ty, py, _mm256_mul_ps(tx, px))), inverseDeterminant);
+
+			const __m256 qx = _mm256_fmsub_ps(ty, e1z, _mm256_mul_ps(tz, e1y));
+			const __m256 qy = _mm256_fmsub_ps(tz, e1x, _mm256_mul_ps(tx, e1z));
+			const __m256 qz = _mm256_fmsub_ps(tx, e1y, _mm256_mul_ps(ty, e1x));
+			const __m256 v = _mm256_mul_ps(_mm256_fmadd_ps(_rays.Dz, qz, _mm256_fmadd_ps(_rays.Dy, qy, _mm256_mul_ps(_rays.Dx, qx))), inverseDeterminant);
+			const __m256 t = _mm256_mul_ps(_mm256_fmadd_ps(e2z, qz, _mm256_fmadd_ps(e2y, qy, _mm256_mul_ps(e2x, qx))), inverseDeterminant);
+
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.0f);
+			__m256 hit = _mm256_and_ps(_lanes, _mm256_cmp_ps(determinant, zero, _CMP_NEQ_OQ));
+			hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+			hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+			hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GT_OQ), _mm256_cmp_ps(t, _t, _CMP_LT_OQ)));
+			_t = _mm256_blendv_ps(_t, t, hit);
+			_primitives = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(_primitives),
+				_mm256_castsi256_ps(_mm256_set1_epi32(int(_index))), hit));
+		}
+
+		// The lanes that fail a test drop out of the mask, so the later tests and the blends only touch the rest
+		CRT_TARGET_AVX512 inline void IntersectTriangle(const Triangle& _triangle, uint32_t _index, const RayLanes16& _rays,
+			__mmask16 _lanes, __m512& _t, __m512i& _primitives)
+		{
+			const float3 edge1 = _triangle.V1 - _triangle.V0;
+			const float3 edge2 = _triangle.V2 - _triangle.V0;
+			const __m512 e1x = _mm512_set1_ps(edge1.x), e1y = _mm512_set1_ps(edge1.y), e1z = _mm512_set1_ps(edge1.z);
+			const __m512 e2x = _mm512_set1_ps(edge2.x), e2y = _mm512_set1_ps(edge2.y), e2z = _mm512_set1_ps(edge2.z);
+
+			const __m512 px = _mm512_fmsub_ps(_rays.Dy, e2z, _mm512_mul_ps(_rays.Dz, e2y));
+			const __m512 py = _mm512_fmsub_ps(_rays.Dz, e2x, _mm512_mul_ps(_rays.Dx, e2z));
+			const __m512 pz = _mm512_fmsub_ps(_rays.Dx, e2y, _mm512_mul_ps(_rays.Dy, e2x));
+			const __m512 determinant = _mm512_fmadd_ps(e1z, pz, _mm512_fmadd_ps(e1y, py, _mm512_mul_ps(e1x, px)));
+			__mmask16 hit = _mm512_mask_cmp_ps_mask(_lanes, determinant, _mm512_setzero_ps(), _CMP_NEQ_OQ);
+			const __m512 inverseDeterminant = _mm512_div_ps(_mm512_set1_ps(1.0f), determinant);
+
+			const __m512 tx = _mm512_sub_ps(_rays.Ox, _mm512_set1_ps(_triangle.V0.x));
+			const __m512 ty = _mm512_sub_ps(_rays.Oy, _mm512_set1_ps(_triangle.V0.y));
+			const __m512 tz = _mm512_sub_ps(_rays.Oz, _mm512_set1_ps(_triangle.V0.z));
+			const __m512 u = _mm512_mul_ps(_mm512_fmadd_ps(tz, pz, _mm512_fmadd_ps(ty, py, _mm512_mul_ps(tx, px))), inverseDeterminant);
+			hit = _mm512_mask_cmp_ps_mask(hit, u, _mm512_setzero_ps(), _CMP_GE_OQ);
+			hit = _mm512_mask_cmp_ps_mask(hit, u, _mm512_set1_ps(1.0f), _CMP_LE_OQ);
+			if (hit == 0)
+			{
+				return;
+			}
+
+			const __m512 qx = _mm512_fmsub_ps(ty, e1z, _mm512_mul_ps(tz, e1y));
+			const __m512 qy = _mm512_fmsub_ps(tz, e1x, _mm512_mul_ps(tx, e1z));
+			const __m512 qz = _mm512_fmsub_ps(tx, e1y, _mm512_mul_ps(ty, e1x));
+			const __m512 v = _mm512_mul_ps(_mm512_fmadd_ps(_rays.Dz, qz, _mm512_fmadd_ps(_rays.Dy, qy, _mm512_mul_ps(_rays.Dx, qx))), inverseDeterminant);
+			hit = _mm512_mask_cmp_ps_mask(hit, v, _mm512_setzero_ps(), _CMP_GE_OQ);
+			hit = _mm512_mask_cmp_ps_mask(hit, _mm512_add_ps(u, v), _mm512_set1_ps(1.0f), _CMP_LE_OQ);
+			const __m512 t = _mm512_mul_ps(_mm512_fmadd_ps(e2z, qz, _mm512_fmadd_ps(e2y, qy, _mm512_mul_ps(e2x, qx))), inverseDeterminant);
+			hit = _mm512_mask_cmp_ps_mask(hit, t, _mm512_setzero_ps(), _CMP_GT_OQ);
+			hit = _mm512_mask_cmp_ps_mask(hit, t, _t, _CMP_LT_OQ);
+			_t = _mm512_mask_mov_ps(_t, hit, t);
+			_primitives = _mm512_mask_mov_epi32(_primitives, hit, _mm512_set1_epi32(int(_index)));
+		}
+
+		CRT_TARGET_AVX2 inline __m256 GetLaneMask(uint32_t _lanes)
+		{
+			const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+			return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(int(_lanes)), bits), bits));
+		}
+
+		CRT_TARGET_AVX2 inline float GetNearestEntry(__m256 _values, __m256 _lanes)
+		{
+			const __m256 values = _mm256_blendv_ps(_mm256_set1_ps(FLT_MAX), _values, _lanes);
+			__m128 nearest = _mm_min_ps(_mm256_castps256_ps128(values), _mm256_extractf128_ps(values, 1));
+			nearest = _mm_min_ps(nearest, _mm_movehl_ps(nearest, nearest));
+			return _mm_cvtss_f32(_mm_min_ss(nearest, _mm_shuffle_ps(nearest, nearest, 1)));
+		}
+	}
+
 	BVH::BVH(const std::vector<Primitive>& _primitives, const Texture* _heightMap) :
 		m_Primitives(_primitives),
 		m_Heightmap(_heightMap)
 	{
 		if (_primitives.empty())
 		{
-			throw std::exception("No primitives provided");
+			throw std::runtime_error("No primitives provided");
 		}
 		Construct();
+		BuildTreelets();
 	}
 
 	void BVH::Construct()
@@ -46,6 +184,48 @@ namespace CRT
 		m_RootNode = SplitChild(m_RootNode, indices, primNodes, centroidBounds, 1);
 	}
 
+	void BVH::BuildTreelets()
+	{
+		m_NodeTreelets.assign(m_Nodes.size(), 0);
+		// Filled first in first out, so a treelet's number is higher than that of the one it hangs off
+		std::deque<const BVHNode*> roots = { &m_RootNode };
+		uint32_t treelet = 0;
+		for (; !roots.empty(); treelet++)
+		{
+			// Grown breadth first, so the treelet is as wide as it is deep
+			std::deque<const BVHNode*> frontier = { roots.front() };
+			roots.pop_front();
+			size_t size = 0;
+			while (!frontier.empty())
+			{
+				const BVHNode* node = frontier.front();
+				const size_t nodeSize = sizeof(BVHNode) + node->Count * (sizeof(Primitive) + sizeof(PrimitiveIndex));
+				if (size > 0 && size + nodeSize > TreeletSize)
+				{
+					break;
+				}
+				frontier.pop_front();
+				size += nodeSize;
+				if (node != &m_RootNode)
+				{
+					m_NodeTreelets[node - m_Nodes.data()] = treelet;
+				}
+				if (node->Count == 0)
+				{
+					frontier.push_back(&m_Nodes[node->Left]);
+					frontier.push_back(&m_Nodes[node->Left + 1ull]);
+				}
+			}
+			roots.insert(roots.end(), frontier.begin(), frontier.end());
+		}
+		m_TreeletCount = treelet;
+	}
+
+	uint32_t BVH::GetTreelet(const BVHNode& _node) const
+	{
+		return &_node == &m_RootNode ? 0 : m_NodeTreelets[&_node - m_Nodes.data()];
+	}
+
 	BVHNode BVH::SplitChild(BVHNode _node, const std::vector<PrimitiveIndex>& _range, const std::vector<PrimitiveNode>& _primitiveNodes, AABB _centroidBounds, size_t _currentDepth)
 	{
 		if (_range.size() > 1)
@@ -71,6 +251,7 @@ namespace CRT
 			float splitWidth = centroidDimensions.f[splitDimension];
 			if (splitWidth == 0.0f)
 			{
+				m_MaxDepth = std::max(_currentDepth, m_MaxDepth);
 				_node.First = uint32_t(m_PrimitiveIndices.size());
 				m_PrimitiveIndices.insert(m_PrimitiveIndices.end(), _range.begin(), _range.end());
 				_node.Count = uint32_t(_range.size());
@@ -200,12 +381,335 @@ namespace CRT
 		TraverseNode(ray, _result, m_RootNode, first);
 	}
 
+	void BVH::GetNearestIntersections(const Ray* _rays, uint32_t _count, std::optional<Manifest>* _nearest) const
+	{
+		struct Traversal
+		{
+			uint32_t Ray;
+			uint32_t StackSize = 0;
+		};
+		// Every level a ray descends pushes at most one more node than it pops
+		const uint32_t stackDepth = uint32_t(m_MaxDepth) + 1;
+		thread_local std::vector<const BVHNode*> stacks;
+		stacks.resize(InterleavedRays * stackDepth);
+
+		std::array<Traversal, InterleavedRays> traversals;
+		uint32_t nextRay = 0;
+		const auto start = [&](Traversal& _traversal, const BVHNode** _stack)
+		{
+			while (nextRay < _count)
+			{
+				const uint32_t ray = nextRay++;
+				if (m_RootNode.Bounds.Intersects(_rays[ray]))
+				{
+					_traversal.Ray = ray;
+					_traversal.StackSize = 1;
+					_stack[0] = &m_RootNode;
+					return;
+				}
+			}
+		};
+		for (uint32_t i = 0; i < InterleavedRays; i++)
+		{
+			start(traversals[i], &stacks[i * stackDepth]);
+		}
+
+		bool active = true;
+		while (active)
+		{
+			active = false;
+			for (uint32_t i = 0; i < InterleavedRays; i++)
+			{
+				Traversal& traversal = traversals[i];
+				if (traversal.StackSize == 0)
+				{
+					continue;
+				}
+				active = true;
+
+				const Ray& ray = _rays[traversal.Ray];
+				const BVHNode** stack = &stacks[i * stackDepth];
+				const BVHNode& node = *stack[--traversal.StackSize];
+				if (node.Count > 0)
+				{
+					IntersectLeaf(ray, node, _nearest[traversal.Ray]);
+				}
+				else
+				{
+					// Pushed right first, so the left child is traversed first like the recursive traversal does
+					const BVHNode& left = m_Nodes[node.Left];
+					const BVHNode& right = m_Nodes[node.Left + 1ull];
+					if (right.Bounds.Intersects(ray))
+					{
+						stack[traversal.StackSize++] = &right;
+					}
+					if (left.Bounds.Intersects(ray))
+					{
+						stack[traversal.StackSize++] = &left;
+					}
+				}
+
+				if (traversal.StackSize == 0)
+				{
+					start(traversal, stack);
+				}
+				if (traversal.StackSize > 0)
+				{
+					// The next node's bounds are in the cache already, its children or primitives aren't
+					const BVHNode& next = *stack[traversal.StackSize - 1];
+					const void* address = next.Count > 0 ? (const void*)&m_PrimitiveIndices[next.First] : (const void*)&m_Nodes[next.Left];
+					_mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0);
+				}
+			}
+		}
+	}
+
+	void BVH::GetNearestIntersectionsByTreelet(const Ray* _rays, uint32_t _count, std::optional<Manifest>* _nearest) const
+	{
+		struct QueuedRay
+		{
+			uint32_t Ray;
+			// Where the ray enters the treelet
+			const BVHNode* Node;
+		};
+		// Shared by the BVHs of all meshes, only ever grown
+		thread_local std::vector<std::vector<QueuedRay>> queues;
+		thread_local std::vector<const BVHNode*> stack;
+		if (queues.size() < m_TreeletCount)
+		{
+			queues.resize(m_TreeletCount);
+		}
+
+		for (uint32_t i = 0; i < _count; i++)
+		{
+			if (m_RootNode.Bounds.Intersects(_rays[i]))
+			{
+				queues[0].push_back({ i, &m_RootNode });
+			}
+		}
+
+		for (uint32_t treelet = 0; treelet < m_TreeletCount; treelet++)
+		{
+			std::vector<QueuedRay>& queue = queues[treelet];
+			for (const QueuedRay& queued : queue)
+			{
+				const Ray& ray = _rays[queued.Ray];
+				stack.push_back(queued.Node);
+				while (!stack.empty())
+				{
+					const BVHNode& node = *stack.back();
+					stack.pop_back();
+					if (node.Count > 0)
+					{
+						IntersectLeaf(ray, node, _nearest[queued.Ray]);
+						continue;
+					}
+
+					for (const BVHNode* child : { &m_Nodes[node.Left + 1ull], &m_Nodes[node.Left] })
+					{
+						if (!child->Bounds.Intersects(ray))
+						{
+							continue;
+						}
+						const uint32_t childTreelet = GetTreelet(*child);
+						if (childTreelet == treelet)
+						{
+							stack.push_back(child);
+						}
+						else
+						{
+							queues[childTreelet].push_back({ queued.Ray, child });
+						}
+					}
+				}
+			}
+			queue.clear();
+		}
+	}
+
+	void BVH::GetNearestIntersectionsInPackets(const Ray* _rays, uint32_t _count, std::optional<Manifest>* _nearest) const
+	{
+		const EInstructionSet instructionSet = CpuFeatures::GetInstructionSet();
+		if (m_Heightmap != nullptr || instructionSet < EInstructionSet::AVX2)
+		{
+			GetNearestIntersections(_rays, _count, _nearest);
+			return;
+		}
+
+		const uint32_t width = instructionSet >= EInstructionSet::AVX512 ? 16u : 8u;
+		std::array<uint32_t, 16> primitives;
+		for (uint32_t first = 0; first < _count; first += width)
+		{
+			const uint32_t count = std::min(width, _count - first);
+			if (width == 16u)
+			{
+				TracePacket16(&_rays[first], count, &_nearest[first], primitives.data());
+			}
+			else
+			{
+				TracePacket8(&_rays[first], count, &_nearest[first], primitives.data());
+			}
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (primitives[i] == NoPrimitive)
+				{
+					continue;
+				}
+				// The manifest comes from the same intersection the single rays use. Where it misses after all,
+				// on the very edge of the triangle, the ray is traced on its own
+				const Ray& ray = _rays[first + i];
+				std::optional<Manifest>& nearest = _nearest[first + i];
+				Manifest manifest;
+				if (!m_Primitives[primitives[i]].Intersect(ray, manifest))
+				{
+					GetNearestIntersections(&ray, 1, &nearest);
+				}
+				else if (!nearest || manifest.T < nearest->T)
+				{
+					manifest.M = nullptr;
+					nearest = manifest;
+				}
+			}
+		}
+	}
+
+	void BVH::TracePacket8(const Ray* _rays, uint32_t _count, const std::optional<Manifest>* _nearest, uint32_t* _primitives) const
+	{
+		const RayLanes8 rays(_rays, _count);
+		alignas(32) float nearest[8];
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			nearest[i] = i < _count && _nearest[i] ? _nearest[i]->T : FLT_MAX;
+		}
+		__m256 t = _mm256_load_ps(nearest);
+		__m256i primitives = _mm256_set1_epi32(int(NoPrimitive));
+
+		thread_local std::vector<PacketNode> stack;
+		stack.clear();
+		__m256 entries;
+		const __m256 root = _mm256_and_ps(rays.Active, IntersectBounds(m_RootNode.Bounds, rays, t, entries));
+		if (_mm256_movemask_ps(root) != 0)
+		{
+			stack.push_back({ &m_RootNode, uint32_t(_mm256_movemask_ps(root)) });
+		}
+		while (!stack.empty())
+		{
+			const PacketNode packetNode = stack.back();
+			stack.pop_back();
+			const BVHNode& node = *packetNode.Node;
+			const __m256 lanes = GetLaneMask(packetNode.Lanes);
+			if (node.Count > 0)
+			{
+				for (uint32_t i = node.First; i < node.First + node.Count; i++)
+				{
+					IntersectTriangle(m_Primitives[m_PrimitiveIndices[i]], m_PrimitiveIndices[i], rays, lanes, t, primitives);
+				}
+				continue;
+			}
+
+			// Lanes that found a hit since the node was pushed may skip the children now
+			const BVHNode& left = m_Nodes[node.Left];
+			const BVHNode& right = m_Nodes[node.Left + 1ull];
+			__m256 leftEntries, rightEntries;
+			const __m256 leftLanes = _mm256_and_ps(lanes, IntersectBounds(left.Bounds, rays, t, leftEntries));
+			const __m256 rightLanes = _mm256_and_ps(lanes, IntersectBounds(right.Bounds, rays, t, rightEntries));
+			const PacketNode leftNode = { &left, uint32_t(_mm256_movemask_ps(leftLanes)) };
+			const PacketNode rightNode = { &right, uint32_t(_mm256_movemask_ps(rightLanes)) };
+			// The child the packet enters first is traversed first, so its hits cull more of the other one
+			const bool leftFirst = GetNearestEntry(leftEntries, leftLanes) <= GetNearestEntry(rightEntries, rightLanes);
+			for (const PacketNode& child : { leftFirst ? rightNode : leftNode, leftFirst ? leftNode : rightNode })
+			{
+				if (child.Lanes != 0)
+				{
+					stack.push_back(child);
+				}
+			}
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(_primitives), primitives);
+	}
+
+	void BVH::TracePacket16(const Ray* _rays, uint32_t _count, const std::optional<Manifest>* _nearest, uint32_t* _primitives) const
+	{
+		const RayLanes16 rays(_rays, _count);
+		alignas(64) float nearest[16];
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			nearest[i] = i < _count && _nearest[i] ? _nearest[i]->T : FLT_MAX;
+		}
+		__m512 t = _mm512_load_ps(nearest);
+		__m512i primitives = _mm512_set1_epi32(int(NoPrimitive));
+
+		thread_local std::vector<PacketNode> stack;
+		stack.clear();
+		__m512 entries;
+		const __mmask16 root = IntersectBounds(m_RootNode.Bounds, rays, rays.Active, t, entries);
+		if (root != 0)
+		{
+			stack.push_back({ &m_RootNode, root });
+		}
+		while (!stack.empty())
+		{
+			const PacketNode packetNode = stack.back();
+			stack.pop_back();
+			const BVHNode& node = *packetNode.Node;
+			const __mmask16 lanes = __mmask16(packetNode.Lanes);
+			if (node.Count > 0)
+			{
+				for (uint32_t i = node.First; i < node.First + node.Count; i++)
+				{
+					IntersectTriangle(m_Primitives[m_PrimitiveIndices[i]], m_PrimitiveIndices[i], rays, lanes, t, primitives);
+				}
+				continue;
+			}
+
+			const BVHNode& left = m_Nodes[node.Left];
+			const BVHNode& right = m_Nodes[node.Left + 1ull];
+			__m512 leftEntries, rightEntries;
+			const __mmask16 leftLanes = IntersectBounds(left.Bounds, rays, lanes, t, leftEntries);
+			const __mmask16 rightLanes = IntersectBounds(right.Bounds, rays, lanes, t, rightEntries);
+			const bool leftFirst = _mm512_mask_reduce_min_ps(leftLanes, leftEntries) <= _mm512_mask_reduce_min_ps(rightLanes, rightEntries);
+			const PacketNode leftNode = { &left, leftLanes };
+			const PacketNode rightNode = { &right, rightLanes };
+			for (const PacketNode& child : { leftFirst ? rightNode : leftNode, leftFirst ? leftNode : rightNode })
+			{
+				if (child.Lanes != 0)
+				{
+					stack.push_back(child);
+				}
+			}
+		}
+		_mm512_storeu_si512(_primitives, primitives);
+	}
+
+	void BVH::IntersectLeaf(const Ray& _ray, const BVHNode& _leaf, std::optional<Manifest>& _nearest) const
+	{
+		for (uint32_t i = _leaf.First; i < _leaf.First + _leaf.Count; i++)
+		{
+			Manifest manifest;
+			if (m_Primitives[m_PrimitiveIndices[i]].IntersectDisplaced(_ray, manifest, m_Heightmap)
+				&& (!_nearest || manifest.T < _nearest->T))
+			{
+				// The mesh knows the material
+				manifest.M = nullptr;
+				_nearest = manifest;
+			}
+		}
+	}
+
 	uint64_t BVH::GetNodeCount() const
 	{
 		// Add one for the root node
 		return m_Nodes.size() + 1;
 	}
 
+	void BVH::InterleaveMemory() const
+	{
+		NumaTopology::InterleaveMemory(m_Nodes.data(), m_Nodes.size() * sizeof(BVHNode));
+		NumaTopology::InterleaveMemory(m_Primitives.data(), m_Primitives.size() * sizeof(Primitive));
+		NumaTopology::InterleaveMemory(m_PrimitiveIndices.data(), m_PrimitiveIndices.size() * sizeof(uint32_t));
+	}
+
 	TraversalResult BVH::TraverseNode(const Ray& _ray, const BVHNode& _parentNode) const
 	{
 		if (_parentNode.Count > 0)
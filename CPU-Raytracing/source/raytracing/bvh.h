@@ -43,9 +43,21 @@ namespace CRT
 		float SplitCost = 0.0f;
 	};
 
+	enum class ETraversalMode
+	{
+		/* One ray after the other */
+		SingleRay,
+		/* A few rays at once, a step of each in turn, so their cache misses overlap */
+		Interleaved,
+		/* Batches of rays queued at the treelets they enter, every treelet is brought into the cache once per batch */
+		Treelets,
+		/* Packets of eight or sixteen rays, as many as the vectors of the CPU hold, through the same nodes at once */
+		Packets
+	};
+
 	struct TraversalResult
 	{
-		std::optional<Manifest> Manifest;
+		std::optional<CRT::Manifest> Manifest;
 		float Depth = 0.0f;
 	};
 
@@ -56,8 +68,24 @@ namespace CRT
 
 		TraversalResult GetNearestIntersection(const Ray& ray) const;
 		void GetNearestIntersection(const RayPacket& ray, TraversalResultPacket& _result) const;
+		// Traverses a few independent rays at once, a step of one after the other, and prefetches the next node
+		// of each ray before moving on to the next, so the cache misses of the rays overlap. Replaces the
+		// nearest hits with the ones found here when they are nearer, those don't have a material yet.
+		// Doesn't track the traversal depth
+		void GetNearestIntersections(const Ray* _rays, uint32_t _count, std::optional<Manifest>* _nearest) const;
+		// Same for a batch of rays traversed one treelet after the other. Rays that leave a treelet are queued at
+		// the one they enter, which always comes later, so every treelet is brought into the cache once per batch
+		// instead of once per ray. Of hits at exactly the same distance a different one may be kept
+		void GetNearestIntersectionsByTreelet(const Ray* _rays, uint32_t _count, std::optional<Manifest>* _nearest) const;
+		// Same for consecutive rays of a batch traversed together as a packet, a node is visited once for all rays
+		// of the packet that hit it. Sixteen rays at a time with AVX-512, eight with AVX2, one at a time without
+		// either or on displaced triangles. Pays off for rays that hit the same nodes, e.g. the primary ones.
+		// Of hits at exactly the same distance or on the edge of two triangles a different one may be kept
+		void GetNearestIntersectionsInPackets(const Ray* _rays, uint32_t _count, std::optional<Manifest>* _nearest) const;
 
 		uint64_t GetNodeCount() const;
+		// Spreads the nodes and primitives over the memory of all NUMA nodes
+		void InterleaveMemory() const;
 	private:
 		TraversalResult TraverseNode(const Ray& ray, const BVHNode& parentNode) const;
 		void TraverseNode(const RayPacket& ray, TraversalResultPacket& _result, const BVHNode& parentNode, int _firstActive)const;
@@ -65,6 +93,14 @@ namespace CRT
 		TraversalResult GetNearest(const Ray& _ray, const PrimitiveRange& range) const;
 
 		void Construct();
+		// Splits the tree into treelets, subtrees whose nodes and primitives take about TreeletSize bytes
+		void BuildTreelets();
+		uint32_t GetTreelet(const BVHNode& _node) const;
+		void IntersectLeaf(const Ray& _ray, const BVHNode& _leaf, std::optional<Manifest>& _nearest) const;
+		// Finds the primitive of the nearest hit of each ray that is nearer than the ones given, NoPrimitive where
+		// there is none
+		CRT_TARGET_AVX2 void TracePacket8(const Ray* _rays, uint32_t _count, const std::optional<Manifest>* _nearest, uint32_t* _primitives) const;
+		CRT_TARGET_AVX512 void TracePacket16(const Ray* _rays, uint32_t _count, const std::optional<Manifest>* _nearest, uint32_t* _primitives) const;
 		BVHNode SplitChild(BVHNode _node, const std::vector<PrimitiveIndex>& _range, const std::vector<PrimitiveNode>& _primitiveNodes, AABB _centroidBounds, size_t _currenDepth);
 		SplitPoint CalculateSplitpoint(const std::vector<PrimitiveIndex>& _range) const;
 		int32_t GetSplitDimension(const std::vector<PrimitiveIndex>& _range) const;
@@ -74,11 +110,20 @@ namespace CRT
 			std::vector<PrimitiveIndex>::const_iterator _end) const;
 
 		constexpr static uint32_t MaxBins = 16u;
+		// Rays traversed at once, enough to cover the latency of memory with the work of the others
+		constexpr static uint32_t InterleavedRays = 8u;
+		// Fits the caches closest to the core, which most rays through a treelet then only have to wait on once
+		constexpr static uint32_t TreeletSize = 128u * 1024u;
+		constexpr static uint32_t NoPrimitive = UINT32_MAX;
 		const Texture* m_Heightmap;
 		std::vector<Primitive> m_Primitives;
 		std::vector<uint32_t> m_PrimitiveIndices;
 		std::vector<BVHNode> m_Nodes;
 		BVHNode m_RootNode;
 		uint64_t m_MaxDepth = 0;
+		// Treelet of every node, the root node is in the first one. Numbered top down, so a treelet's parent
+		// always has a lower number
+		std::vector<uint32_t> m_NodeTreelets;
+		uint32_t m_TreeletCount = 0;
 	};
 }
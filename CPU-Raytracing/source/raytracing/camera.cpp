@@ -1,5 +1,7 @@
 #include "camera.h"
 
+#include <algorithm>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <./core/math/trigonometry.h>
@@ -16,8 +18,10 @@ namespace CRT
 		m_Front(float3::Forward()),
 		m_Up(float3::Up()),
 		m_Right(float3::Right()),
-		m_View(ConstructView())
+		m_View(ConstructView()),
+		m_InverseView(glm::inverse(m_View))
 	{
+		UpdateBasis();
 	}
 
 	void Camera::SetPosition(float3 position)
@@ -30,83 +34,196 @@ namespace CRT
 		return m_Position;
 	}
 
-	Ray Camera::ConstructRay(int _id, int _x, int _y) const
+	Ray Camera::ConstructRay(int _id, int _x, int _y, float2 _offset) const
 	{
-		float3 focalDirection(0.0, 0.0, -1.0);
-		float3 cameraPlane = m_FocalLength * focalDirection;
-		float3 p0 = cameraPlane + float3(-1, 1, 0);
-		float3 p1 = cameraPlane + float3(1, 1, 0);
-		float3 p2 = cameraPlane + float3(-1, -1, 0);
-
 		uint32_t xa, ya;
 		morton_to_xy(_id, &xa, &ya);
+		return Ray(m_Position, GetDirection((float)xa + _x + _offset.x, (float)ya + _y + _offset.y));
+	}
+
+	void Camera::ConstructDirections(uint32_t _x, uint32_t _y, uint32_t _count, const float2* _offsets, float3* _directions) const
+	{
+		const EInstructionSet instructionSet = CpuFeatures::GetInstructionSet();
+		if (instructionSet >= EInstructionSet::AVX512)
+		{
+			ConstructDirectionsAVX512(_x, _y, _count, _offsets, _directions);
+			return;
+		}
+		if (instructionSet >= EInstructionSet::AVX2)
+		{
+			ConstructDirectionsAVX2(_x, _y, _count, _offsets, _directions);
+			return;
+		}
+		for (uint32_t id = 0; id < _count; id++)
+		{
+			uint32_t xa, ya;
+			morton_to_xy(id, &xa, &ya);
+			const float2 offset = _offsets != nullptr ? _offsets[id] : float2(0.0f);
+			_directions[id] = GetDirection(float(_x + xa) + offset.x, float(_y + ya) + offset.y);
+		}
+	}
+
+	void Camera::ConstructDirectionsAVX2(uint32_t _x, uint32_t _y, uint32_t _count, const float2* _offsets, float3* _directions) const
+	{
+		// Every aligned group of eight morton ids covers the same 4x2 block, only its corner has to be decoded
+		const __m256 blockX = _mm256_setr_ps(0.0f, 1.0f, 0.0f, 1.0f, 2.0f, 3.0f, 2.0f, 3.0f);
+		const __m256 blockY = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
+		const __m256 topLeftX = _mm256_set1_ps(m_TopLeft.x);
+		const __m256 topLeftY = _mm256_set1_ps(m_TopLeft.y);
+		const __m256 topLeftZ = _mm256_set1_ps(m_TopLeft.z);
+		const __m256 deltaXX = _mm256_set1_ps(m_PixelDeltaX.x);
+		const __m256 deltaXY = _mm256_set1_ps(m_PixelDeltaX.y);
+		const __m256 deltaXZ = _mm256_set1_ps(m_PixelDeltaX.z);
+		const __m256 deltaYX = _mm256_set1_ps(m_PixelDeltaY.x);
+		const __m256 deltaYY = _mm256_set1_ps(m_PixelDeltaY.y);
+		const __m256 deltaYZ = _mm256_set1_ps(m_PixelDeltaY.z);
+		for (uint32_t id = 0; id < _count; id += 8)
+		{
+			// Like the AVX-512 kernel, the last group of a count that isn't a multiple of eight reads and writes
+			// only its first lanes, the unused offsets stay zero
+			const uint32_t lanes = std::min(_count - id, 8u);
+			uint32_t xa, ya;
+			morton_to_xy(id, &xa, &ya);
+			__m256 x = _mm256_add_ps(_mm256_set1_ps(float(_x + xa)), blockX);
+			__m256 y = _mm256_add_ps(_mm256_set1_ps(float(_y + ya)), blockY);
+			if (_offsets != nullptr)
+			{
+				alignas(32) float offsetX[8] = {};
+				alignas(32) float offsetY[8] = {};
+				for (uint32_t i = 0; i < lanes; i++)
+				{
+					offsetX[i] = _offsets[id + i].x;
+					offsetY[i] = _offsets[id + i].y;
+				}
+				x = _mm256_add_ps(x, _mm256_load_ps(offsetX));
+				y = _mm256_add_ps(y, _mm256_load_ps(offsetY));
+			}
 
-		float u = ((float)xa + _x) / ((float)m_ViewportSize.x - 1.0f);
-		float v = ((float)ya + _y) / ((float)m_ViewportSize.y - 1.0f);
+			__m256 dx = _mm256_fmadd_ps(y, deltaYX, _mm256_fmadd_ps(x, deltaXX, topLeftX));
+			__m256 dy = _mm256_fmadd_ps(y, deltaYY, _mm256_fmadd_ps(x, deltaXY, topLeftY));
+			__m256 dz = _mm256_fmadd_ps(y, deltaYZ, _mm256_fmadd_ps(x, deltaXZ, topLeftZ));
+			const __m256 lengthSquared = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+			// A full division rather than rsqrt, primary rays should match ConstructRay
+			const __m256 inverseLength = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(lengthSquared));
 
-		float3 uv = p0 + (u * (p1 - p0)) + (v * (p2 - p0));
-		float aspect_ratio = m_ViewportSize.x / (float)m_ViewportSize.y;
-		uv.x *= aspect_ratio;
-		float3 d = (Transform((uv), m_View)).Normalize();
-		return Ray(m_Position, d);
+			alignas(32) float directionX[8];
+			alignas(32) float directionY[8];
+			alignas(32) float directionZ[8];
+			_mm256_store_ps(directionX, _mm256_mul_ps(dx, inverseLength));
+			_mm256_store_ps(directionY, _mm256_mul_ps(dy, inverseLength));
+			_mm256_store_ps(directionZ, _mm256_mul_ps(dz, inverseLength));
+			for (uint32_t i = 0; i < lanes; i++)
+			{
+				_directions[id + i] = float3(directionX[i], directionY[i], directionZ[i]);
+			}
+		}
 	}
 
-	RayPacket Camera::ConstructRayPacket(int _id, int _x, int _y) const
+	void Camera::ConstructDirectionsAVX512(uint32_t _x, uint32_t _y, uint32_t _count, const float2* _offsets, float3* _directions) const
 	{
-		float3 focalDirection(0.0, 0.0, -1.0);
-		float3 cameraPlane = m_FocalLength * focalDirection;
-		float3 p0 = cameraPlane + float3(-1, 1, 0);
-		float3 p1 = cameraPlane + float3(1, 1, 0);
-		float3 p2 = cameraPlane + float3(-1, -1, 0);
+		// Every aligned group of sixteen morton ids covers the same 4x4 block
+		const __m512 blockX = _mm512_setr_ps(0.0f, 1.0f, 0.0f, 1.0f, 2.0f, 3.0f, 2.0f, 3.0f, 0.0f, 1.0f, 0.0f, 1.0f, 2.0f, 3.0f, 2.0f, 3.0f);
+		const __m512 blockY = _mm512_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+		// Picks the x and the y offsets out of the sixteen interleaved pairs
+		const __m512i evenFloats = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+		const __m512i oddFloats = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+		const __m512 topLeftX = _mm512_set1_ps(m_TopLeft.x);
+		const __m512 topLeftY = _mm512_set1_ps(m_TopLeft.y);
+		const __m512 topLeftZ = _mm512_set1_ps(m_TopLeft.z);
+		const __m512 deltaXX = _mm512_set1_ps(m_PixelDeltaX.x);
+		const __m512 deltaXY = _mm512_set1_ps(m_PixelDeltaX.y);
+		const __m512 deltaXZ = _mm512_set1_ps(m_PixelDeltaX.z);
+		const __m512 deltaYX = _mm512_set1_ps(m_PixelDeltaY.x);
+		const __m512 deltaYY = _mm512_set1_ps(m_PixelDeltaY.y);
+		const __m512 deltaYZ = _mm512_set1_ps(m_PixelDeltaY.z);
+		for (uint32_t id = 0; id < _count; id += 16)
+		{
+			// A count that isn't a multiple of sixteen leaves the last group's upper lanes out of the loads
+			const uint32_t lanes = std::min(_count - id, 16u);
+			uint32_t xa, ya;
+			morton_to_xy(id, &xa, &ya);
+			__m512 x = _mm512_add_ps(_mm512_set1_ps(float(_x + xa)), blockX);
+			__m512 y = _mm512_add_ps(_mm512_set1_ps(float(_y + ya)), blockY);
+			if (_offsets != nullptr)
+			{
+				const float* offsets = &_offsets[id].x;
+				const __mmask16 low = lanes >= 8 ? __mmask16(0xffff) : __mmask16((1u << (2 * lanes)) - 1);
+				const __mmask16 high = lanes <= 8 ? __mmask16(0) : lanes >= 16 ? __mmask16(0xffff) : __mmask16((1u << (2 * (lanes - 8))) - 1);
+				const __m512 first = _mm512_maskz_loadu_ps(low, offsets);
+				const __m512 second = _mm512_maskz_loadu_ps(high, offsets + 16);
+				x = _mm512_add_ps(x, _mm512_permutex2var_ps(first, evenFloats, second));
+				y = _mm512_add_ps(y, _mm512_permutex2var_ps(first, oddFloats, second));
+			}
+
+			__m512 dx = _mm512_fmadd_ps(y, deltaYX, _mm512_fmadd_ps(x, deltaXX, topLeftX));
+			__m512 dy = _mm512_fmadd_ps(y, deltaYY, _mm512_fmadd_ps(x, deltaXY, topLeftY));
+			__m512 dz = _mm512_fmadd_ps(y, deltaYZ, _mm512_fmadd_ps(x, deltaXZ, topLeftZ));
+			const __m512 lengthSquared = _mm512_fmadd_ps(dz, dz, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dx, dx)));
+			const __m512 inverseLength = _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_sqrt_ps(lengthSquared));
 
+			alignas(64) float directionX[16];
+			alignas(64) float directionY[16];
+			alignas(64) float directionZ[16];
+			_mm512_store_ps(directionX, _mm512_mul_ps(dx, inverseLength));
+			_mm512_store_ps(directionY, _mm512_mul_ps(dy, inverseLength));
+			_mm512_store_ps(directionZ, _mm512_mul_ps(dz, inverseLength));
+			for (uint32_t i = 0; i < lanes; i++)
+			{
+				_directions[id + i] = float3(directionX[i], directionY[i], directionZ[i]);
+			}
+		}
+	}
+
+	RayPacket Camera::ConstructRayPacket(int _id, int _x, int _y) const
+	{
 		uint32_t xa, ya;
 		float3 dArr[RAYPACKET_WIDTH * RAYPACKET_HEIGHT];
 		for (int i = 0; i < RAYPACKET_WIDTH * RAYPACKET_HEIGHT; i++)
 		{
 			morton_to_xy(_id + i, &xa, &ya);
-
-			float u = ((float)xa + _x) / ((float)m_ViewportSize.x - 1.0f);
-			float v = ((float)ya + _y) / ((float)m_ViewportSize.y - 1.0f);
-
-			float3 uv = p0 + (u * (p1 - p0)) + (v * (p2 - p0));
-			float aspect_ratio = m_ViewportSize.x / (float)m_ViewportSize.y;
-			uv.x *= aspect_ratio;
-			dArr[i] = (Transform((uv), m_View)).Normalize();
+			dArr[i] = GetDirection((float)xa + _x, (float)ya + _y);
 		}
 		return RayPacket(m_Position, dArr, RAYPACKET_WIDTH, RAYPACKET_HEIGHT);
 	}
 
 	OctRay Camera::ConstructOctRay(int _id, int _x, int _y) const
 	{
-		float3 focalDirection(0.0, 0.0, -1.0);
-		float3 cameraPlane = m_FocalLength * focalDirection;
-		float3 p0 = cameraPlane + float3(-1, 1, 0);
-		float3 p1 = cameraPlane + float3(1, 1, 0);
-		float3 p2 = cameraPlane + float3(-1, -1, 0);
-
 		uint32_t xa, ya;
 		float3 dArr[8];
 		for (int i = 0; i < 8; i++)
 		{
 			morton_to_xy(_id + i, &xa, &ya);
-
-			float u = ((float)xa + _x) / ((float)m_ViewportSize.x - 1.0f);
-			float v = ((float)ya + _y) / ((float)m_ViewportSize.y - 1.0f);
-
-			float3 uv = p0 + (u * (p1 - p0)) + (v * (p2 - p0));
-			float aspect_ratio = m_ViewportSize.x / (float)m_ViewportSize.y;
-			uv.x *= aspect_ratio;
-			dArr[i] = (Transform((uv), m_View)).Normalize();
+			dArr[i] = GetDirection((float)xa + _x, (float)ya + _y);
 		}
 		return OctRay(m_Position, dArr);
 	}
 
+	bool Camera::Project(float3 _point, float2& _pixel, float& _depth) const
+	{
+		float3 local = Transform(_point - m_Position, m_InverseView);
+		if (local.z >= 0.0f)
+		{
+			return false;
+		}
+		_depth = -local.z;
+
+		// Scale the direction back onto the camera plane and undo the uv mapping of ConstructRay
+		float3 uv = local * (m_FocalLength / _depth);
+		float aspect_ratio = m_ViewportSize.x / (float)m_ViewportSize.y;
+		float u = (uv.x / aspect_ratio + 1.0f) * 0.5f;
+		float v = (1.0f - uv.y) * 0.5f;
+		_pixel = float2(u * ((float)m_ViewportSize.x - 1.0f), v * ((float)m_ViewportSize.y - 1.0f));
+		return u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f;
+	}
+
 	void Camera::SetDirection(float3 _direction)
 	{
 		m_Front = _direction;
 		m_Right = m_Front.Cross(float3::Up()).Normalize();
 		m_Up = m_Right.Cross(m_Front).Normalize();
 		m_View = ConstructView();
+		m_InverseView = glm::inverse(m_View);
+		UpdateBasis();
 	}
 
 	float3 Camera::GetFront() const
@@ -128,6 +245,7 @@ namespace CRT
 	{
 		// tan(2 / angle) gives us height / distance
 		m_FocalLength = 1 / std::tan(angle / 2);
+		UpdateBasis();
 	}
 
 	float Camera::GetFieldOfView() const
@@ -153,6 +271,21 @@ namespace CRT
 		return glm::inverse(glm::lookAt(ToGlm(float3::Zero()), front, ToGlm(float3::Up())));
 	}
 
+	void Camera::UpdateBasis()
+	{
+		// The camera plane spans [-aspect, aspect] by [1, -1] at the focal length, the view transform is linear
+		// so it can be applied to the corner and the steps separately
+		const float aspectRatio = m_ViewportSize.x / (float)m_ViewportSize.y;
+		m_TopLeft = Transform(float3(-aspectRatio, 1.0f, -m_FocalLength), m_View);
+		m_PixelDeltaX = Transform(float3(2.0f * aspectRatio / (m_ViewportSize.x - 1.0f), 0.0f, 0.0f), m_View);
+		m_PixelDeltaY = Transform(float3(0.0f, -2.0f / (m_ViewportSize.y - 1.0f), 0.0f), m_View);
+	}
+
+	float3 Camera::GetDirection(float _x, float _y) const
+	{
+		return (m_TopLeft + _x * m_PixelDeltaX + _y * m_PixelDeltaY).Normalize();
+	}
+
 	float3 Camera::Transform(float3 _toTransform, glm::mat4 _transform) const
 	{
 		glm::vec4 toTransform = glm::vec4(ToGlm(_toTransform), 0.0f);
@@ -15,10 +15,18 @@ namespace CRT
 		void SetPosition(float3 _position);
 		float3 GetPosition() const;
 
-		Ray ConstructRay(int _id, int _x, int _y) const;
+		// The offset is in pixels, used to jitter samples within a pixel
+		Ray ConstructRay(int _id, int _x, int _y, float2 _offset = float2(0.0f)) const;
+		// Normalized directions of the first _count pixels of the tile at _x, _y in morton order, sixteen at a time
+		// where the CPU has AVX-512 and eight where it has AVX2. The offsets are optional, one per pixel
+		void ConstructDirections(uint32_t _x, uint32_t _y, uint32_t _count, const float2* _offsets, float3* _directions) const;
 		RayPacket ConstructRayPacket(int _id, int _x, int _y) const;
 
-		OctRay ConstructOctRay(int _id, int _x, int _y) const;
+		CRT_TARGET_AVX2 OctRay ConstructOctRay(int _id, int _x, int _y) const;
+
+		// Inverse of ConstructRay, finds the pixel a world space point lands on and its view space depth.
+		// Returns false when the point is behind the camera or outside the viewport
+		bool Project(float3 _point, float2& _pixel, float& _depth) const;
 
 		void SetDirection(float3 _direction);
 		float3 GetFront() const;
@@ -30,6 +38,12 @@ namespace CRT
 		void SetAntiAliasing(uint32_t aaFactor);
 	private:
 		glm::mat4 ConstructView() const;
+		// Caches the direction through the top left pixel and the steps to the next pixel, so constructing a
+		// ray is only a multiply add per axis
+		void UpdateBasis();
+		float3 GetDirection(float _x, float _y) const;
+		CRT_TARGET_AVX2 void ConstructDirectionsAVX2(uint32_t _x, uint32_t _y, uint32_t _count, const float2* _offsets, float3* _directions) const;
+		CRT_TARGET_AVX512 void ConstructDirectionsAVX512(uint32_t _x, uint32_t _y, uint32_t _count, const float2* _offsets, float3* _directions) const;
 		float3 Transform(float3 _toTranform, glm::mat4 _transform) const;
 
 		float m_FocalLength = 1.0f;
@@ -39,6 +53,10 @@ namespace CRT
 		float3 m_Up;
 		float3 m_Right;
 		glm::mat4 m_View;
+		glm::mat4 m_InverseView;
+		float3 m_TopLeft;
+		float3 m_PixelDeltaX;
+		float3 m_PixelDeltaY;
 
 		int m_AntiAliasing = 1;
 	};
@@ -0,0 +1,269 @@
+#include "./raytracing/denoiser.h"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace CRT
+{
+	namespace
+	{
+		// Spline of the à-trous kernel, the 5x5 kernel is its outer product
+		constexpr float KernelWeights[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+		// Luminance may differ by this many standard deviations of the center pixel in the first iteration, halved
+		// by every iteration after it
+		constexpr float ColorSigma = 4.0f;
+		// Relative depth difference per pixel of distance between the taps
+		constexpr float DepthSigma = 0.05f;
+		constexpr float NormalSigma = 64.0f;
+		constexpr float AlbedoSigma = 0.1f;
+		// Keeps the color weight finite for pixels without any noise
+		constexpr float DeviationEpsilon = 1e-4f;
+
+		// e^x for x <= 0, accurate to about 1e-6 relative, which is plenty for filter weights
+		CRT_TARGET_AVX2 inline __m256 ExpNegative(__m256 _x)
+		{
+			const __m256 t = _mm256_mul_ps(_mm256_max_ps(_x, _mm256_set1_ps(-87.0f)), _mm256_set1_ps(1.44269504f));
+			const __m256 whole = _mm256_floor_ps(t);
+			const __m256 f = _mm256_sub_ps(t, whole);
+
+			// 2^f on [0, 1)
+			__m256 p = _mm256_set1_ps(1.333355e-3f);
+			p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(9.618129e-3f));
+			p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(5.550411e-2f));
+			p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(2.402265e-1f));
+			p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(6.931472e-1f));
+			p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f));
+
+			// Multiplies by 2^whole by adding it to the exponent
+			const __m256i exponent = _mm256_slli_epi32(_mm256_cvtps_epi32(whole), 23);
+			return _mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(p), exponent));
+		}
+
+		CRT_TARGET_AVX2 inline __m256 Luminance(__m256 _r, __m256 _g, __m256 _b)
+		{
+			return _mm256_fmadd_ps(_mm256_set1_ps(0.2126f), _r,
+				_mm256_fmadd_ps(_mm256_set1_ps(0.7152f), _g, _mm256_mul_ps(_mm256_set1_ps(0.0722f), _b)));
+		}
+
+		CRT_TARGET_AVX2 inline __m256 Abs(__m256 _x)
+		{
+			return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _x);
+		}
+	}
+
+	Denoiser::Denoiser(uint32_t _width, uint32_t _height)
+		: m_Width(_width)
+		, m_Height(_height)
+		// The last group of a row starts at most Lanes - 1 pixels before its end, so with that much more room even
+		// its widest taps stay within the row
+		, m_Stride(_width + 2 * Border + Lanes - 1)
+	{
+		// Zeroed, so even the lanes that run into the border only ever read finite values
+		const uint64_t size = (uint64_t)m_Stride * (_height + 2 * Border);
+		for (std::array<std::vector<float>, 3>& colors : m_Colors)
+		{
+			for (std::vector<float>& plane : colors)
+			{
+				plane.resize(size);
+			}
+		}
+		for (uint32_t channel = 0; channel < 3; channel++)
+		{
+			m_Normals[channel].resize(size);
+			m_Albedos[channel].resize(size);
+		}
+		m_Depths.resize(size);
+		m_Deviations.resize(size);
+		Clear();
+	}
+
+	void Denoiser::Clear()
+	{
+		// Further away than any miss, so no tap into a cleared pixel gets any weight, whatever else it holds
+		std::fill(m_Depths.begin(), m_Depths.end(), FLT_MAX);
+	}
+
+	void Denoiser::SetPixel(uint32_t _x, uint32_t _y, const float3& _color, float _deviation, const float3& _normal,
+		float _depth, const float3& _albedo)
+	{
+		const uint64_t index = GetIndex(_x, _y);
+		m_Colors[0][0][index] = _color.x;
+		m_Colors[0][1][index] = _color.y;
+		m_Colors[0][2][index] = _color.z;
+		m_Normals[0][index] = _normal.x;
+		m_Normals[1][index] = _normal.y;
+		m_Normals[2][index] = _normal.z;
+		m_Albedos[0][index] = _albedo.x;
+		m_Albedos[1][index] = _albedo.y;
+		m_Albedos[2][index] = _albedo.z;
+		m_Depths[index] = _depth;
+		m_Deviations[index] = _deviation;
+	}
+
+	void Denoiser::SetPixel(uint32_t _x, uint32_t _y, const float3& _color, const Guide& _guide)
+	{
+		SetPixel(_x, _y, _color, _guide.Deviation, _guide.Normal, _guide.Depth, _guide.Albedo);
+	}
+
+	void Denoiser::Filter(uint32_t _iteration, uint32_t _xMin, uint32_t _yMin, uint32_t _width, uint32_t _height)
+	{
+		if (CpuFeatures::GetInstructionSet() >= EInstructionSet::AVX2)
+		{
+			FilterAVX2(_iteration, _xMin, _yMin, _width, _height);
+		}
+		else
+		{
+			FilterScalar(_iteration, _xMin, _yMin, _width, _height);
+		}
+	}
+
+	void Denoiser::FilterScalar(uint32_t _iteration, uint32_t _xMin, uint32_t _yMin, uint32_t _width, uint32_t _height)
+	{
+		const uint32_t step = 1u << _iteration;
+		const std::array<std::vector<float>, 3>& source = m_Colors[_iteration % 2];
+		std::array<std::vector<float>, 3>& destination = m_Colors[(_iteration + 1) % 2];
+		const auto luminance = [&source](uint64_t _index)
+		{
+			return 0.2126f * source[0][_index] + 0.7152f * source[1][_index] + 0.0722f * source[2][_index];
+		};
+
+		const float colorSigma = ColorSigma / float(step);
+		const float depthSigma = DepthSigma * float(step);
+		for (uint32_t y = _yMin; y < _yMin + _height; y++)
+		{
+			for (uint32_t x = _xMin; x < _xMin + _width; x++)
+			{
+				const uint64_t center = GetIndex(x, y);
+				const float centerLuminance = luminance(center);
+				const float depth = m_Depths[center];
+				const float colorScale = 1.0f / (colorSigma * m_Deviations[center] + DeviationEpsilon);
+
+				float weightSum = 0.0f;
+				float3 sum = float3::Zero();
+				for (int32_t dy = -2; dy <= 2; dy++)
+				{
+					for (int32_t dx = -2; dx <= 2; dx++)
+					{
+						const uint64_t tap = center + (int64_t(dy) * m_Stride + dx) * int64_t(step);
+						const float tDepth = m_Depths[tap];
+						float exponent = std::abs(luminance(tap) - centerLuminance) * colorScale;
+						exponent += std::abs(tDepth - depth) / (depthSigma * std::min(depth, tDepth));
+						const float cosine = m_Normals[0][center] * m_Normals[0][tap] + m_Normals[1][center] * m_Normals[1][tap]
+							+ m_Normals[2][center] * m_Normals[2][tap];
+						exponent += (1.0f - cosine) * NormalSigma;
+						const float dr = m_Albedos[0][tap] - m_Albedos[0][center];
+						const float dg = m_Albedos[1][tap] - m_Albedos[1][center];
+						const float db = m_Albedos[2][tap] - m_Albedos[2][center];
+						exponent += (dr * dr + dg * dg + db * db) / (AlbedoSigma * AlbedoSigma);
+
+						const float weight = KernelWeights[dy + 2] * KernelWeights[dx + 2] * std::exp(-exponent);
+						weightSum += weight;
+						sum += float3(source[0][tap], source[1][tap], source[2][tap]) * weight;
+					}
+				}
+
+				sum /= weightSum;
+				destination[0][center] = sum.x;
+				destination[1][center] = sum.y;
+				destination[2][center] = sum.z;
+			}
+		}
+	}
+
+	void Denoiser::FilterAVX2(uint32_t _iteration, uint32_t _xMin, uint32_t _yMin, uint32_t _width, uint32_t _height)
+	{
+		const uint32_t step = 1u << _iteration;
+		const std::array<std::vector<float>, 3>& source = m_Colors[_iteration % 2];
+		std::array<std::vector<float>, 3>& destination = m_Colors[(_iteration + 1) % 2];
+
+		const __m256 colorSigma = _mm256_set1_ps(ColorSigma / float(step));
+		const __m256 depthSigma = _mm256_set1_ps(DepthSigma * float(step));
+		const __m256 normalSigma = _mm256_set1_ps(NormalSigma);
+		const __m256 albedoScale = _mm256_set1_ps(1.0f / (AlbedoSigma * AlbedoSigma));
+		const __m256 one = _mm256_set1_ps(1.0f);
+
+		for (uint32_t y = _yMin; y < _yMin + _height; y++)
+		{
+			// The lanes past the end of a row land in the border, where nothing reads them with any weight
+			for (uint32_t x = _xMin; x < _xMin + _width; x += Lanes)
+			{
+				const uint64_t center = GetIndex(x, y);
+				const __m256 r = _mm256_loadu_ps(&source[0][center]);
+				const __m256 g = _mm256_loadu_ps(&source[1][center]);
+				const __m256 b = _mm256_loadu_ps(&source[2][center]);
+				const __m256 luminance = Luminance(r, g, b);
+				const __m256 nx = _mm256_loadu_ps(&m_Normals[0][center]);
+				const __m256 ny = _mm256_loadu_ps(&m_Normals[1][center]);
+				const __m256 nz = _mm256_loadu_ps(&m_Normals[2][center]);
+				const __m256 ar = _mm256_loadu_ps(&m_Albedos[0][center]);
+				const __m256 ag = _mm256_loadu_ps(&m_Albedos[1][center]);
+				const __m256 ab = _mm256_loadu_ps(&m_Albedos[2][center]);
+				const __m256 depth = _mm256_loadu_ps(&m_Depths[center]);
+				const __m256 colorScale = _mm256_div_ps(one, _mm256_fmadd_ps(colorSigma,
+					_mm256_loadu_ps(&m_Deviations[center]), _mm256_set1_ps(DeviationEpsilon)));
+
+				__m256 weightSum = _mm256_setzero_ps();
+				__m256 rSum = _mm256_setzero_ps();
+				__m256 gSum = _mm256_setzero_ps();
+				__m256 bSum = _mm256_setzero_ps();
+				for (int32_t dy = -2; dy <= 2; dy++)
+				{
+					for (int32_t dx = -2; dx <= 2; dx++)
+					{
+						const uint64_t tap = center + (int64_t(dy) * m_Stride + dx) * int64_t(step);
+						const __m256 tr = _mm256_loadu_ps(&source[0][tap]);
+						const __m256 tg = _mm256_loadu_ps(&source[1][tap]);
+						const __m256 tb = _mm256_loadu_ps(&source[2][tap]);
+						const __m256 tDepth = _mm256_loadu_ps(&m_Depths[tap]);
+
+						// Everything goes into one exponent, so the weight costs a single exp
+						__m256 exponent = _mm256_mul_ps(Abs(_mm256_sub_ps(Luminance(tr, tg, tb), luminance)), colorScale);
+
+						// Relative to the nearer of the two, so a hit next to a miss or the border gets no weight
+						const __m256 nearest = _mm256_min_ps(depth, tDepth);
+						exponent = _mm256_add_ps(exponent, _mm256_div_ps(Abs(_mm256_sub_ps(tDepth, depth)),
+							_mm256_mul_ps(depthSigma, nearest)));
+
+						const __m256 cosine = _mm256_fmadd_ps(nx, _mm256_loadu_ps(&m_Normals[0][tap]),
+							_mm256_fmadd_ps(ny, _mm256_loadu_ps(&m_Normals[1][tap]),
+								_mm256_mul_ps(nz, _mm256_loadu_ps(&m_Normals[2][tap]))));
+						exponent = _mm256_fmadd_ps(_mm256_sub_ps(one, cosine), normalSigma, exponent);
+
+						const __m256 dr = _mm256_sub_ps(_mm256_loadu_ps(&m_Albedos[0][tap]), ar);
+						const __m256 dg = _mm256_sub_ps(_mm256_loadu_ps(&m_Albedos[1][tap]), ag);
+						const __m256 db = _mm256_sub_ps(_mm256_loadu_ps(&m_Albedos[2][tap]), ab);
+						const __m256 albedoDistance = _mm256_fmadd_ps(dr, dr, _mm256_fmadd_ps(dg, dg, _mm256_mul_ps(db, db)));
+						exponent = _mm256_fmadd_ps(albedoDistance, albedoScale, exponent);
+
+						const __m256 weight = _mm256_mul_ps(_mm256_set1_ps(KernelWeights[dy + 2] * KernelWeights[dx + 2]),
+							ExpNegative(_mm256_sub_ps(_mm256_setzero_ps(), exponent)));
+						weightSum = _mm256_add_ps(weightSum, weight);
+						rSum = _mm256_fmadd_ps(weight, tr, rSum);
+						gSum = _mm256_fmadd_ps(weight, tg, gSum);
+						bSum = _mm256_fmadd_ps(weight, tb, bSum);
+					}
+				}
+
+				// The center tap always has a weight, so the sum can't be zero
+				const __m256 normalization = _mm256_div_ps(one, weightSum);
+				_mm256_storeu_ps(&destination[0][center], _mm256_mul_ps(rSum, normalization));
+				_mm256_storeu_ps(&destination[1][center], _mm256_mul_ps(gSum, normalization));
+				_mm256_storeu_ps(&destination[2][center], _mm256_mul_ps(bSum, normalization));
+			}
+		}
+	}
+
+	float3 Denoiser::GetResult(uint32_t _iterationCount, uint32_t _x, uint32_t _y) const
+	{
+		const uint64_t index = GetIndex(_x, _y);
+		const std::array<std::vector<float>, 3>& colors = m_Colors[_iterationCount % 2];
+		return float3(colors[0][index], colors[1][index], colors[2][index]);
+	}
+
+	uint64_t Denoiser::GetIndex(uint32_t _x, uint32_t _y) const
+	{
+		return (uint64_t)(_y + Border) * m_Stride + _x + Border;
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "./core/cpu_features.h"
+#include "./core/math/float3.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace CRT
+{
+	// Edge-avoiding à-trous wavelet filter (Dammertz et al. 2010). Every iteration blurs with a 5x5 kernel whose
+	// taps are twice as far apart as in the last one, and weighs each tap by how much its color, normal, depth
+	// and albedo differ from the center pixel. The color may only differ by a few of the center's standard
+	// deviations, so the filter fades out as the image converges.
+	// The image is kept as planes of floats with a border around them, so eight neighboring pixels are filtered
+	// at once without clamping. Blocks of pixels are filtered independently, e.g. one tile per job
+	class Denoiser
+	{
+	public:
+		constexpr static uint32_t MaxIterations = 5;
+		// Depth of pixels without a hit: finite, so misses can be compared with each other, but far from any hit
+		constexpr static float MissDepth = 1e30f;
+
+		// Everything the filter knows about a pixel besides its color, e.g. to filter an image assembled from the
+		// rows of several renders at once
+		struct Guide
+		{
+			// Of the pixel's luminance
+			float Deviation;
+			float3 Normal;
+			float Depth;
+			float3 Albedo;
+		};
+
+		Denoiser(uint32_t _width, uint32_t _height);
+		// Every pixel becomes part of the border, until it is set again. Unset pixels don't bleed into others
+		void Clear();
+		// The noisy color of a pixel, the standard deviation of its luminance, and the guides of its primary hit
+		void SetPixel(uint32_t _x, uint32_t _y, const float3& _color, float _deviation, const float3& _normal,
+			float _depth, const float3& _albedo);
+		void SetPixel(uint32_t _x, uint32_t _y, const float3& _color, const Guide& _guide);
+		// Runs one iteration over a block of pixels. Reads the whole result of the previous iteration around the
+		// block, so all blocks of an iteration have to be done before the next one starts
+		void Filter(uint32_t _iteration, uint32_t _xMin, uint32_t _yMin, uint32_t _width, uint32_t _height);
+		// A pixel after the given number of iterations
+		float3 GetResult(uint32_t _iterationCount, uint32_t _x, uint32_t _y) const;
+
+	private:
+		// The widest kernel reaches two taps of the last iteration's step out
+		constexpr static uint32_t Border = 2u << (MaxIterations - 1);
+		constexpr static uint32_t Lanes = 8;
+
+		uint64_t GetIndex(uint32_t _x, uint32_t _y) const;
+		// A pixel at a time, for CPUs without AVX2
+		void FilterScalar(uint32_t _iteration, uint32_t _xMin, uint32_t _yMin, uint32_t _width, uint32_t _height);
+		CRT_TARGET_AVX2 void FilterAVX2(uint32_t _iteration, uint32_t _xMin, uint32_t _yMin, uint32_t _width, uint32_t _height);
+
+		uint32_t m_Width;
+		uint32_t m_Height;
+		// Width of a plane's row, including the border on both sides and room for a partial group of lanes
+		uint32_t m_Stride;
+
+		// Ping-ponged between the iterations, the input goes into the first one
+		std::array<std::array<std::vector<float>, 3>, 2> m_Colors;
+		std::array<std::vector<float>, 3> m_Normals;
+		std::array<std::vector<float>, 3> m_Albedos;
+		std::vector<float> m_Depths;
+		std::vector<float> m_Deviations;
+	};
+}
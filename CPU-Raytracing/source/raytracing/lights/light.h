@@ -7,7 +7,7 @@ namespace CRT
 
 	struct ShadowRay
 	{
-		Ray Ray;
+		CRT::Ray Ray;
 		float MaxT = 0.0f;
 	};
 
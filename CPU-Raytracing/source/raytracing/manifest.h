@@ -3,6 +3,8 @@
 #include "./core/math/float3.h"
 #include "./raytracing/material/material.h"
 
+#include <cfloat>
+
 namespace CRT
 {
 	class Manifest
@@ -15,15 +15,16 @@ namespace CRT
 	class Material
 	{
 	public:
-		Material(float3 _color, float _specularity, Texture* _texture, Texture* _heightmap = nullptr)
+		Material(float3 _color, float _specularity, CRT::Texture* _texture, CRT::Texture* _heightmap = nullptr)
 			: Color(_color)
 			, Specularity(_specularity)
 			, Texture(_texture)
 			, HeightMap(_heightmap)
 		{ }
 
-		Texture* HeightMap;
-		Texture* Texture;
+		// Qualified, as the member named Texture hides the class within Material
+		CRT::Texture* HeightMap;
+		CRT::Texture* Texture;
 
 		float3 Color;
 		float Specularity;
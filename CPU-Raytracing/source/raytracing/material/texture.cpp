@@ -1,4 +1,5 @@
 #include "./raytracing/material/texture.h"
+#include "./core/aligned_memory.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <./stb_image.h>
@@ -13,7 +14,7 @@ namespace CRT
 		float* image = stbi_loadf(_filepath.c_str(), &m_Width, &m_Height, &channels, STBI_rgb_alpha);
 
 		// Allign buffer to 64
-		m_Buffer = (float*)_aligned_malloc(m_Width * m_Height * sizeof(float) * 4, 64);
+		m_Buffer = (float*)AlignedMalloc(m_Width * m_Height * sizeof(float) * 4, 64);
 
 		for (uint32_t i = 0; i < m_Width * m_Height; i++)
 		{
@@ -1,5 +1,7 @@
 #include "./raytracing/ray.h"
 
+#include <algorithm>
+
 namespace CRT
 {
 	Ray Ray::Reflect(float3 _n)
@@ -43,6 +45,62 @@ namespace CRT
 		_z = _mm256_add_ps(Oz, _mm256_mul_ps(Dz, t));
 	}
 
+	namespace
+	{
+		// Transposes the rays into one row per component, the full division keeps the inverse directions the
+		// same as the ones the single rays use
+		template<uint32_t Lanes>
+		void Transpose(const Ray* _rays, uint32_t _count, float (&_components)[9][Lanes])
+		{
+			for (uint32_t i = 0; i < Lanes; i++)
+			{
+				const Ray& ray = _rays[std::min(i, _count - 1)];
+				_components[0][i] = ray.O.x;
+				_components[1][i] = ray.O.y;
+				_components[2][i] = ray.O.z;
+				_components[3][i] = ray.D.x;
+				_components[4][i] = ray.D.y;
+				_components[5][i] = ray.D.z;
+				_components[6][i] = 1.0f / ray.D.x;
+				_components[7][i] = 1.0f / ray.D.y;
+				_components[8][i] = 1.0f / ray.D.z;
+			}
+		}
+	}
+
+	RayLanes8::RayLanes8(const Ray* _rays, uint32_t _count)
+	{
+		float components[9][8];
+		Transpose(_rays, _count, components);
+		Ox = _mm256_loadu_ps(components[0]);
+		Oy = _mm256_loadu_ps(components[1]);
+		Oz = _mm256_loadu_ps(components[2]);
+		Dx = _mm256_loadu_ps(components[3]);
+		Dy = _mm256_loadu_ps(components[4]);
+		Dz = _mm256_loadu_ps(components[5]);
+		rDx = _mm256_loadu_ps(components[6]);
+		rDy = _mm256_loadu_ps(components[7]);
+		rDz = _mm256_loadu_ps(components[8]);
+		const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		Active = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(int(_count)), lanes));
+	}
+
+	RayLanes16::RayLanes16(const Ray* _rays, uint32_t _count)
+	{
+		float components[9][16];
+		Transpose(_rays, _count, components);
+		Ox = _mm512_loadu_ps(components[0]);
+		Oy = _mm512_loadu_ps(components[1]);
+		Oz = _mm512_loadu_ps(components[2]);
+		Dx = _mm512_loadu_ps(components[3]);
+		Dy = _mm512_loadu_ps(components[4]);
+		Dz = _mm512_loadu_ps(components[5]);
+		rDx = _mm512_loadu_ps(components[6]);
+		rDy = _mm512_loadu_ps(components[7]);
+		rDz = _mm512_loadu_ps(components[8]);
+		Active = _count >= 16 ? __mmask16(0xffff) : __mmask16((1u << _count) - 1);
+	}
+
 	void RayPacket::CalculateFrustum(float3* _corners)
 	{
 		P[0] = (_corners[0] - O).Cross(_corners[1] - _corners[0]).Normalize(); DD[0] = P[0].Dot(O);
@@ -1,9 +1,16 @@
 #pragma once
+#include "./core/cpu_features.h"
 #include "./core/math/float3.h"
 #include <glm/mat4x4.hpp>
 
 #include <limits.h>
+#include <cfloat>
+#include <utility>
+#if defined(_MSC_VER)
 #include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
 #include <xmmintrin.h>
 
 // #define USE_RAYPACKET
@@ -104,10 +111,11 @@ namespace CRT
 		void CalculateFrustum(float3* _corners);
 	};
 
+	// The eight wide types of the USE_AVX path, which is chosen at compile time and needs AVX2 on every machine
 	class TraversalResult__m256
 	{
 	public:
-		TraversalResult__m256()
+		CRT_TARGET_AVX2 TraversalResult__m256()
 			: T(_mm256_set1_ps(FLT_MAX))
 		{ }
 
@@ -121,7 +129,7 @@ namespace CRT
 	class OctRay
 	{
 	public:
-		OctRay(float3 _o, float3* _d)
+		CRT_TARGET_AVX2 OctRay(float3 _o, float3* _d)
 			: Ox(_mm256_setr_ps(_o.x, _o.x, _o.x, _o.x, _o.x, _o.x, _o.x, _o.x))
 			, Oy(_mm256_setr_ps(_o.y, _o.y, _o.y, _o.y, _o.y, _o.y, _o.y, _o.y))
 			, Oz(_mm256_setr_ps(_o.z, _o.z, _o.z, _o.z, _o.z, _o.z, _o.z, _o.z))
@@ -133,8 +141,8 @@ namespace CRT
 			, rDz(_mm256_rcp_ps(_mm256_setr_ps(_d[0].z, _d[1].z, _d[2].z, _d[3].z, _d[4].z, _d[5].z, _d[6].z, _d[7].z)))
 		{ }
 
-		void Sample(float t, __m256& _x, __m256& _y, __m256& _z) const;
-		void Sample(__m256 t, __m256& _x, __m256& _y, __m256& _z) const;
+		CRT_TARGET_AVX2 void Sample(float t, __m256& _x, __m256& _y, __m256& _z) const;
+		CRT_TARGET_AVX2 void Sample(__m256 t, __m256& _x, __m256& _y, __m256& _z) const;
 
 		__m256 Ox;
 		__m256 Oy;
@@ -148,14 +156,116 @@ namespace CRT
 		__m256 rDz;
 	};
 
+	// Up to eight rays of a batch in the lanes of AVX2 registers, for the packet traversal. Lanes past the
+	// rays' count repeat the last ray and are left out of Active
+	class RayLanes8
+	{
+	public:
+		CRT_TARGET_AVX2 RayLanes8(const Ray* _rays, uint32_t _count);
+
+		__m256 Ox;
+		__m256 Oy;
+		__m256 Oz;
+
+		__m256 Dx;
+		__m256 Dy;
+		__m256 Dz;
+		__m256 rDx;
+		__m256 rDy;
+		__m256 rDz;
+		// All bits set in the lanes that hold a ray
+		__m256 Active;
+	};
+
+	// Same for up to sixteen rays in AVX-512 registers, the lanes that hold a ray are a mask register
+	class RayLanes16
+	{
+	public:
+		CRT_TARGET_AVX512 RayLanes16(const Ray* _rays, uint32_t _count);
+
+		__m512 Ox;
+		__m512 Oy;
+		__m512 Oz;
+
+		__m512 Dx;
+		__m512 Dy;
+		__m512 Dz;
+		__m512 rDx;
+		__m512 rDy;
+		__m512 rDz;
+		__mmask16 Active;
+	};
+
+	// The Morton codes are built with shifts and masks instead of BMI2's pdep and pext, which not every CPU has
+	// and some only run in microcode. Moves the lowest 16 bits of a value to every other bit
+	inline uint32_t spread_bits_2(uint32_t v)
+	{
+		v &= 0x0000ffff;
+		v = (v | (v << 8)) & 0x00ff00ff;
+		v = (v | (v << 4)) & 0x0f0f0f0f;
+		v = (v | (v << 2)) & 0x33333333;
+		return (v | (v << 1)) & 0x55555555;
+	}
+
+	// Gathers every other bit of a value, starting at the lowest
+	inline uint32_t compact_bits_2(uint64_t v)
+	{
+		v &= 0x5555555555555555;
+		v = (v | (v >> 1)) & 0x3333333333333333;
+		v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0f;
+		v = (v | (v >> 4)) & 0x00ff00ff00ff00ff;
+		v = (v | (v >> 8)) & 0x0000ffff0000ffff;
+		return uint32_t((v | (v >> 16)) & 0x00000000ffffffff);
+	}
+
+	// Moves the lowest ten bits of a value to every third bit
+	inline uint32_t spread_bits_3(uint32_t v)
+	{
+		v &= 0x000003ff;
+		v = (v | (v << 16)) & 0x030000ff;
+		v = (v | (v << 8)) & 0x0300f00f;
+		v = (v | (v << 4)) & 0x030c30c3;
+		return (v | (v << 2)) & 0x09249249;
+	}
+
 	inline uint64_t xy_to_morton(uint32_t x, uint32_t y)
 	{
-		return _pdep_u32(x, 0x55555555) | _pdep_u32(y, 0xaaaaaaaa);
+		return spread_bits_2(x) | (spread_bits_2(y) << 1);
 	}
 
 	inline void morton_to_xy(uint64_t m, uint32_t* x, uint32_t* y)
 	{
-		*x = _pext_u64(m, 0x5555555555555555);
-		*y = _pext_u64(m, 0xaaaaaaaaaaaaaaaa);
+		*x = compact_bits_2(m);
+		*y = compact_bits_2(m >> 1);
+	}
+
+	// Interleaves the lowest ten bits of each coordinate
+	inline uint32_t xyz_to_morton(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return spread_bits_3(x) | (spread_bits_3(y) << 1) | (spread_bits_3(z) << 2);
+	}
+
+	// Position along the Hilbert curve through a grid of 2^order by 2^order cells. Unlike the Morton order,
+	// consecutive cells are always neighbours
+	inline uint64_t xy_to_hilbert(uint32_t x, uint32_t y, uint32_t order)
+	{
+		uint64_t d = 0;
+		for (uint32_t s = (1u << order) >> 1; s > 0; s >>= 1)
+		{
+			const uint32_t rx = (x & s) > 0;
+			const uint32_t ry = (y & s) > 0;
+			d += (uint64_t)s * s * ((3 * rx) ^ ry);
+			// Rotate the quadrant so the curve inside it starts and ends next to its neighbours
+			if (ry == 0)
+			{
+				if (rx == 1)
+				{
+					x = s - 1 - (x & (s - 1));
+					y = s - 1 - (y & (s - 1));
+				}
+				std::swap(x, y);
+			}
+		}
+		return d;
 	}
 }
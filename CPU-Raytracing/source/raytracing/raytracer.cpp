@@ -1,82 +1,1014 @@
 #include "raytracer.h"
 
 #include <./core/graphics/screen/surface.h>
+#include <./core/graphics/screen/pixel_packing.h>
+#include <./core/graphics/color3.h>
 #include <./raytracing/camera.h>
 #include <./raytracing/scene.h>
+#include <./raytracing/wavefront.h>
 #include <random>
 #include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <numeric>
+#include <cfloat>
+#include <cmath>
 
 namespace CRT
 {
-	Raytracer::Raytracer(Surface& _surface, const Scene& _scene, const Camera& _camera) :
+	Raytracer::Raytracer(Surface& _surface, const Scene& _scene, const Camera& _camera, int _threadCount, EThreadAffinity _affinity) :
 		m_Surface(_surface),
 		m_Scene(_scene),
 		m_Camera(_camera),
-		m_JobManager([]() { return RandomGenerator(std::random_device()()); })
+		m_FrameCamera(_camera),
+		m_Target(&_surface),
+		m_JobManager([]() { return RandomGenerator(std::random_device()()); }, _threadCount, _affinity),
+		m_ReprojectionTargets((uint64_t)_surface.GetWidth() * _surface.GetHeight()),
+		m_TilesX((_surface.GetWidth() + JobWidth - 1) / JobWidth),
+		m_TilesY((_surface.GetHeight() + JobWidth - 1) / JobWidth),
+		m_NodeTiles(m_JobManager.GetNodeCount())
 	{
-		m_LastResults.reserve((uint64_t)m_Surface.GetWidth() * m_Surface.GetHeight());
+		m_LastResults.reserve((uint64_t)m_TilesX * m_TilesY);
+		m_Accumulator.resize((uint64_t)_surface.GetWidth() * _surface.GetHeight());
+		m_LuminanceSquares.resize(m_Accumulator.size());
+		m_Tiles.resize((uint64_t)m_TilesX * m_TilesY);
+		m_TileEnd = uint32_t(m_Tiles.size());
+		SplitTilesOverNodes();
+		m_TilePriorities.resize(m_Tiles.size());
+		m_TileOrder.resize(m_Tiles.size());
+		m_TileSequence.resize(m_Tiles.size());
+		UpdateTileSequence();
+		m_Hits.resize(m_Accumulator.size());
+		m_HistoryHits.resize(m_Accumulator.size());
+		m_HistoryColors.resize(m_Accumulator.size());
+		m_GBuffer.resize(m_Accumulator.size());
+		for (std::atomic<uint64_t>& target : m_ReprojectionTargets)
+		{
+			target.store(EmptyReprojectionTarget);
+		}
+
+		// Only captures this, so copying it to the workers every frame doesn't allocate
+		m_TileWorker = [this](RandomGenerator& _generator) { DispatchTiles(_generator); };
+		m_FrameCancelled = [this]() { return IsFrameCancelled(); };
+
+		if (_affinity == EThreadAffinity::NUMANode)
+		{
+			// Every node's workers traverse the whole BVH, so no node should hold all of it
+			m_Scene.InterleaveMemory();
+		}
+
+		// The dispatching thread blocks until each pass is done, so it can't be the caller's thread. Started
+		// once instead of per frame, so beginning a frame doesn't create a thread
+		m_Dispatcher = std::thread([this] { DispatchFrames(); });
+	}
+
+	Raytracer::~Raytracer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_FrameMutex);
+			m_StopDispatching = true;
+		}
+		m_FrameChanged.notify_all();
+		m_Dispatcher.join();
 	}
 
 	void Raytracer::RenderFrame()
 	{
-		for (uint32_t y = 0; y < m_Surface.GetHeight(); y += JobWidth)
+		BeginFrame(m_Surface);
+		WaitForFrame();
+	}
+
+	void Raytracer::BeginFrame(Surface& _target)
+	{
+		assert(_target.GetWidth() == m_Surface.GetWidth() && _target.GetHeight() == m_Surface.GetHeight());
+		WaitForFrame();
+
+		m_Target = &_target;
+		m_FrameGeneration = m_Generation.load();
+		// The workers only read this copy, so the camera can keep moving while the frame is traced
+		m_FrameCamera = m_Camera;
+		const bool cameraMoved = HasCameraMoved();
+		m_LastCameraPosition = m_Camera.GetPosition();
+		m_LastCameraFront = m_Camera.GetFront();
+		m_LastFieldOfView = m_Camera.GetFieldOfView();
+
+		{
+			std::lock_guard<std::mutex> lock(m_FrameMutex);
+			m_FrameCameraMoved = cameraMoved;
+			m_FramePending = true;
+		}
+		m_FrameChanged.notify_all();
+	}
+
+	bool Raytracer::WaitForFrame()
+	{
+		std::unique_lock<std::mutex> lock(m_FrameMutex);
+		m_FrameChanged.wait(lock, [this] { return !m_FramePending; });
+		return !IsFrameCancelled();
+	}
+
+	void Raytracer::DispatchFrames()
+	{
+		std::unique_lock<std::mutex> lock(m_FrameMutex);
+		while (true)
 		{
-			for (uint32_t x = 0; x < m_Surface.GetWidth(); x += JobWidth)
+			// A frame handed over before the raytracer is destroyed is still finished
+			m_FrameChanged.wait(lock, [this] { return m_FramePending || m_StopDispatching; });
+			if (!m_FramePending)
 			{
-				m_LastResults.emplace_back(CreateJob(x, y));
+				return;
 			}
+			const bool cameraMoved = m_FrameCameraMoved;
+			lock.unlock();
+
+			m_FrameTimer = Timer();
+			TraceFrame(cameraMoved);
+			if (IsFrameCancelled())
+			{
+				AbandonFrame();
+			}
+			m_FrameDuration = m_FrameTimer.GetDuration();
+
+			lock.lock();
+			m_FramePending = false;
+			m_FrameChanged.notify_all();
 		}
+	}
 
-		for (auto& result : m_LastResults)
+	void Raytracer::CancelFrame()
+	{
+		m_Generation.fetch_add(1);
+	}
+
+	Timer::Duration Raytracer::GetFrameDuration() const
+	{
+		return m_FrameDuration;
+	}
+
+	void Raytracer::TraceFrame(bool _cameraMoved)
+	{
+		m_Denoised = false;
+		m_ActiveTiles.store(0);
+		m_ReprojectedPixels.store(0);
+		if (_cameraMoved)
 		{
-			JobOutput output = result.get();
-			for (uint32_t y = 0; y < JobWidth; y++)
+			m_GBufferValid = false;
+			const bool budgeted = m_FrameBudget > Timer::Duration(0.0f);
+			// A budgeted frame gets its preview from the coarse pass instead
+			const bool reproject = !budgeted && m_Reprojection && m_HistoryValid;
+			if (reproject)
+			{
+				std::swap(m_Hits, m_HistoryHits);
+				// Needs the old tile states to resolve the last frame, so it has to run before the reset
+				RunTilePass(&Raytracer::SplatTile, m_TileSequence);
+			}
+			ResetTiles();
+
+			if (reproject)
+			{
+				// Doesn't count as a sample, the first frame after the camera stopped traces every pixel again
+				RunTilePass(&Raytracer::ReprojectTile, m_TileSequence);
+				return;
+			}
+			if (budgeted)
 			{
-				for (uint32_t x = 0; x < JobWidth; x++)
+				RunTilePass(&Raytracer::CoarseTile, m_TileSequence);
+				// Sorted within the shares, so every node only refines its own tiles. Equally rated tiles keep
+				// the tile order
+				m_TileOrder = m_TileSequence;
+				for (const NodeTiles& tiles : m_NodeTiles)
 				{
-					// To-do: jobs can exceed our width/height, should check inside the job
-					if (x + output.XMin < m_Surface.GetWidth() && y + output.YMin < m_Surface.GetHeight())
-					{
-						float3 color = output.Color[x + y * JobWidth];
-						m_Surface.Set(x + output.XMin, y + output.YMin,
-							(0xff000000 | (int(color.x * 255) << 16) | (int(color.y * 255) << 8) | int(color.z * 255)));
-					}
+					std::stable_sort(m_TileOrder.begin() + tiles.Begin, m_TileOrder.begin() + tiles.End,
+						[this](uint32_t _a, uint32_t _b) { return m_TilePriorities[_a] > m_TilePriorities[_b]; });
 				}
+				// Like the reprojected frame this isn't a sample, unrefined tiles are traced when the camera stops
+				RunTilePass(&Raytracer::RefineTile, m_TileOrder);
+				return;
 			}
 		}
+
+		// Debug drawing needs the traversal of the primary rays
+		m_Relighting = m_GBufferValid && m_SampleCount == 0 && m_Scene.GetBVHDebugSetting() == ETraversalDebugSetting::None;
+		const bool fillsGBuffer = m_SampleCount == 0;
+		RunTilePass(&Raytracer::RenderTile, m_TileSequence);
+		if (!IsFrameCancelled())
+		{
+			m_SampleCount++;
+			m_HistoryValid = true;
+#if !defined(USE_AVX) && !defined(USE_RAYPACKET)
+			// The packet paths don't report their hits
+			m_GBufferValid = m_GBufferValid || fillsGBuffer;
+#endif
+			// The guides come from the G-buffer, without it the sample is shown as it is
+			if (m_DenoiseIterations > 0 && m_GBufferValid)
+			{
+				RunTilePass(&Raytracer::PrepareDenoiseTile, m_TileSequence);
+				for (m_DenoiseIteration = 0; m_DenoiseIteration < m_DenoiseIterations; m_DenoiseIteration++)
+				{
+					RunTilePass(&Raytracer::DenoiseTile, m_TileSequence);
+				}
+				m_Denoised = !IsFrameCancelled();
+			}
+		}
+	}
+
+	bool Raytracer::IsFrameCancelled() const
+	{
+		return m_Generation.load(std::memory_order_relaxed) != m_FrameGeneration;
+	}
+
+	void Raytracer::AbandonFrame()
+	{
+		// Skipped tiles didn't take their splats out of the targets, and didn't record their primary hits
+		for (std::atomic<uint64_t>& target : m_ReprojectionTargets)
+		{
+			target.store(EmptyReprojectionTarget, std::memory_order_relaxed);
+		}
+		m_HistoryValid = false;
+		m_GBufferValid = false;
+	}
+
+	void Raytracer::RunTilePass(TilePass _pass, const std::vector<uint32_t>& _order)
+	{
+		m_TilePass = _pass;
+		m_PassOrder = &_order;
+		if (m_RenderMode == ERenderMode::PersistentWorkers)
+		{
+			for (NodeTiles& tiles : m_NodeTiles)
+			{
+				tiles.Next.store(tiles.Begin);
+			}
+			m_FrameBarrier.Reset(m_JobManager.GetWorkerCount());
+			m_JobManager.Broadcast(m_TileWorker);
+			m_FrameBarrier.Wait();
+			return;
+		}
+
+		// Workers pop their own queue from the back, so queue in reverse to start the first tiles of a pass first
+		for (uint32_t position = m_TileEnd; position-- > m_TileBegin;)
+		{
+			m_LastResults.emplace_back(CreateJob(_order[position]));
+		}
+
+		for (auto& result : m_LastResults)
+		{
+			result.get();
+		}
 		m_LastResults.clear();
 	}
 
-	std::future<Raytracer::JobOutput> Raytracer::CreateJob(uint32_t _xMin, uint32_t _yMin)
+	void Raytracer::ResetAccumulation()
+	{
+		ResetTiles();
+		// The scene changed, so the last frame can't be reused either
+		m_HistoryValid = false;
+		m_GBufferValid = false;
+	}
+
+	void Raytracer::ResetLighting()
+	{
+		ResetTiles();
+		// Reprojection reuses colors, which are stale now. The primary hits are still where they were
+		m_HistoryValid = false;
+	}
+
+	void Raytracer::ResetTiles()
+	{
+		m_SampleCount = 0;
+		m_Denoised = false;
+		for (TileState& tile : m_Tiles)
+		{
+			tile = TileState{};
+		}
+	}
+
+	bool Raytracer::IsConverged() const
+	{
+		if (HasCameraMoved())
+		{
+			return false;
+		}
+		for (uint32_t tile = m_TileBegin; tile < m_TileEnd; tile++)
+		{
+			if (!m_Tiles[tile].Converged && m_Tiles[tile].SampleCount < m_Camera.GetAntiAliasing())
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void Raytracer::ResolveImage(std::vector<float3>& _image, uint32_t _yBegin, uint32_t _yEnd) const
+	{
+		const uint32_t width = m_Surface.GetWidth();
+		_yEnd = std::min(_yEnd, m_Surface.GetHeight());
+		_image.resize((uint64_t)(_yEnd - std::min(_yBegin, _yEnd)) * width);
+		for (uint32_t y = _yBegin; y < _yEnd; y++)
+		{
+			const float3* accumulated = &m_Accumulator[(uint64_t)y * width];
+			float3* destination = &_image[(uint64_t)(y - _yBegin) * width];
+			if (m_Denoised)
+			{
+				for (uint32_t x = 0; x < width; x++)
+				{
+					destination[x] = m_Denoiser->GetResult(m_DenoiseIterations, x, y);
+				}
+				continue;
+			}
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const uint32_t tile = x / JobWidth + y / JobWidth * m_TilesX;
+				destination[x] = accumulated[x] * (1.0f / std::max(1u, m_Tiles[tile].SampleCount));
+			}
+		}
+	}
+
+	bool Raytracer::ResolveDenoiseGuides(std::vector<Denoiser::Guide>& _guides, uint32_t _yBegin, uint32_t _yEnd) const
+	{
+		if (!m_GBufferValid)
+		{
+			return false;
+		}
+		const uint32_t width = m_Surface.GetWidth();
+		_yEnd = std::min(_yEnd, m_Surface.GetHeight());
+		_yBegin = std::min(_yBegin, _yEnd);
+		_guides.resize((uint64_t)(_yEnd - _yBegin) * width);
+		std::array<float3, JobWidth * JobWidth> colors;
+		std::array<Denoiser::Guide, JobWidth * JobWidth> guides;
+		for (uint32_t tileY = _yBegin / JobWidth; tileY * JobWidth < _yEnd; tileY++)
+		{
+			for (uint32_t tileX = 0; tileX < m_TilesX; tileX++)
+			{
+				ResolveTileGuides(tileX + tileY * m_TilesX, colors, guides);
+				const uint32_t xMin = tileX * JobWidth;
+				const uint32_t tileWidth = std::min(JobWidth, width - xMin);
+				for (uint32_t y = std::max(_yBegin, tileY * JobWidth); y < std::min(_yEnd, (tileY + 1) * JobWidth); y++)
+				{
+					std::copy_n(&guides[(y - tileY * JobWidth) * JobWidth], tileWidth, &_guides[(uint64_t)(y - _yBegin) * width + xMin]);
+				}
+			}
+		}
+		return true;
+	}
+
+	void Raytracer::SetTileRows(uint32_t _begin, uint32_t _end)
+	{
+		m_TileBegin = std::min(_begin, m_TilesY) * m_TilesX;
+		m_TileEnd = std::max(m_TileBegin, std::min(_end, m_TilesY) * m_TilesX);
+		// Tiles outside of the old range never stored their primary hits
+		m_GBufferValid = false;
+		m_Denoised = false;
+		if (m_Denoiser)
+		{
+			// Rows of the old range would otherwise be filtered into the new one
+			m_Denoiser->Clear();
+		}
+		SplitTilesOverNodes();
+		UpdateTileSequence();
+	}
+
+	void Raytracer::UpdateTileSequence()
+	{
+		std::iota(m_TileSequence.begin(), m_TileSequence.end(), 0u);
+		if (m_TileOrderType == ETileOrder::RowMajor)
+		{
+			return;
+		}
+
+		// The curves cover a square power of two grid, tiles outside of the screen are simply skipped
+		uint32_t order = 0;
+		while ((1u << order) < std::max(m_TilesX, m_TilesY))
+		{
+			order++;
+		}
+		std::vector<uint64_t> keys(m_Tiles.size());
+		for (uint32_t tile = m_TileBegin; tile < m_TileEnd; tile++)
+		{
+			const uint32_t x = tile % m_TilesX;
+			const uint32_t y = tile / m_TilesX;
+			keys[tile] = m_TileOrderType == ETileOrder::Morton ? xy_to_morton(x, y) : xy_to_hilbert(x, y, order);
+		}
+		std::sort(m_TileSequence.begin() + m_TileBegin, m_TileSequence.begin() + m_TileEnd,
+			[&keys](uint32_t _a, uint32_t _b) { return keys[_a] < keys[_b]; });
+	}
+
+	void Raytracer::SplitTilesOverNodes()
+	{
+		const uint32_t tileCount = m_TileEnd - m_TileBegin;
+		const uint32_t workerCount = m_JobManager.GetWorkerCount();
+		uint32_t workersBefore = 0;
+		for (uint32_t node = 0; node < uint32_t(m_NodeTiles.size()); node++)
+		{
+			m_NodeTiles[node].Begin = m_TileBegin + uint32_t((uint64_t)tileCount * workersBefore / workerCount);
+			workersBefore += m_JobManager.GetNodeWorkerCount(node);
+			m_NodeTiles[node].End = m_TileBegin + uint32_t((uint64_t)tileCount * workersBefore / workerCount);
+		}
+	}
+
+	uint32_t Raytracer::GetTileRowCount() const
+	{
+		return m_TilesY;
+	}
+
+	uint32_t Raytracer::GetSampleCount() const
+	{
+		return m_SampleCount;
+	}
+
+	uint32_t Raytracer::GetTileCount() const
+	{
+		return uint32_t(m_Tiles.size());
+	}
+
+	uint32_t Raytracer::GetActiveTileCount() const
+	{
+		return m_ActiveTiles.load();
+	}
+
+	void Raytracer::SetAdaptiveSampling(bool _enabled)
+	{
+		m_AdaptiveSampling = _enabled;
+		for (TileState& tile : m_Tiles)
+		{
+			tile.Converged = false;
+		}
+	}
+
+	bool Raytracer::IsAdaptiveSamplingEnabled() const
+	{
+		return m_AdaptiveSampling;
+	}
+
+	void Raytracer::SetAdaptiveThreshold(float _threshold)
+	{
+		m_AdaptiveThreshold = _threshold;
+		// Let the tiles re-evaluate against the new threshold, their samples stay valid
+		for (TileState& tile : m_Tiles)
+		{
+			tile.Converged = false;
+		}
+	}
+
+	float Raytracer::GetAdaptiveThreshold() const
+	{
+		return m_AdaptiveThreshold;
+	}
+
+	void Raytracer::SetReprojection(bool _enabled)
+	{
+		m_Reprojection = _enabled;
+	}
+
+	bool Raytracer::IsReprojectionEnabled() const
+	{
+		return m_Reprojection;
+	}
+
+	uint32_t Raytracer::GetReprojectedPixelCount() const
+	{
+		return m_ReprojectedPixels.load();
+	}
+
+	void Raytracer::SetFrameBudget(Timer::Duration _budget)
+	{
+		m_FrameBudget = _budget;
+	}
+
+	Timer::Duration Raytracer::GetFrameBudget() const
+	{
+		return m_FrameBudget;
+	}
+
+	void Raytracer::SetRenderMode(ERenderMode _renderMode)
+	{
+		m_RenderMode = _renderMode;
+	}
+
+	ERenderMode Raytracer::GetRenderMode() const
+	{
+		return m_RenderMode;
+	}
+
+	void Raytracer::SetTileOrder(ETileOrder _tileOrder)
+	{
+		// A frame in flight is still reading the sequence
+		WaitForFrame();
+		m_TileOrderType = _tileOrder;
+		UpdateTileSequence();
+	}
+
+	ETileOrder Raytracer::GetTileOrder() const
+	{
+		return m_TileOrderType;
+	}
+
+	void Raytracer::SetDenoiseIterations(uint32_t _iterations)
+	{
+		// A frame in flight might still be filtering
+		WaitForFrame();
+		m_DenoiseIterations = std::min(_iterations, Denoiser::MaxIterations);
+		m_Denoised = false;
+		if (m_DenoiseIterations > 0 && !m_Denoiser)
+		{
+			m_Denoiser = std::make_unique<Denoiser>(m_Surface.GetWidth(), m_Surface.GetHeight());
+		}
+	}
+
+	uint32_t Raytracer::GetDenoiseIterations() const
+	{
+		return m_DenoiseIterations;
+	}
+
+	std::future<void> Raytracer::CreateJob(uint32_t _tile)
 	{
-		std::function<JobOutput(RandomGenerator&)> func
+		std::function<void(RandomGenerator&)> func
 			=
-			[this, _xMin, _yMin]
+			[this, _tile, pass = m_TilePass]
 		(RandomGenerator& generator) {
-			JobOutput output{ _xMin, _yMin };
+			(this->*pass)(_tile, generator);
+		};
+		return m_JobManager.AddJob(std::move(func));
+	}
+
+	void Raytracer::RenderTile(uint32_t _tile, RandomGenerator& _generator)
+	{
+		const uint32_t xMin = (_tile % m_TilesX) * JobWidth;
+		const uint32_t yMin = (_tile / m_TilesX) * JobWidth;
+		// Tiles on the right and bottom edge can stick out of the surface, clip once per tile
+		const uint32_t width = std::min(JobWidth, m_Target->GetWidth() - xMin);
+		const uint32_t height = std::min(JobWidth, m_Target->GetHeight() - yMin);
+
+		// Also drops the tiles of a cancelled frame that were still queued
+		if (IsFrameCancelled())
+		{
+			return;
+		}
+
+		TileState& state = m_Tiles[_tile];
+		std::array<float3, JobWidth * JobWidth> colors;
+		if (state.Converged || state.SampleCount >= std::max(1u, m_FrameCamera.GetAntiAliasing()))
+		{
+			// Still resolve, the surface might not hold this tile's latest result
+			ResolveTile(xMin, yMin, state.SampleCount, colors);
+		}
+		else
+		{
+			m_ActiveTiles.fetch_add(1, std::memory_order_relaxed);
+
+			// The first sample goes through the pixel corner like before, so interactive frames look the same
+			const bool jitter = state.SampleCount > 0;
+#if defined(USE_AVX) || defined(USE_RAYPACKET)
 			for (uint32_t jobID = 0; jobID < JobWidth * JobWidth; jobID += JOB_INC)
 			{
+				// Nothing of the tile was stored yet, so it can stop without leaving a partial sample behind
+				if (jobID % CancelCheckInterval == 0 && jobID > 0 && IsFrameCancelled())
+				{
+					return;
+				}
 #if defined(USE_AVX)
-				OctRay r = m_Camera.ConstructOctRay(jobID, _xMin, _yMin);
-				m_Scene.Intersect(r, output.Color.data(), jobID);
+				OctRay r = m_FrameCamera.ConstructOctRay(jobID, xMin, yMin);
+				m_Scene.Intersect(r, colors.data(), jobID);
 #else
-#if defined(USE_RAYPACKET)
-				RayPacket r = m_Camera.ConstructRayPacket(jobID, _xMin, _yMin);
-				m_Scene.Intersect(r, output.Color.data(), jobID);
+				RayPacket r = m_FrameCamera.ConstructRayPacket(jobID, xMin, yMin);
+				m_Scene.Intersect(r, colors.data(), jobID);
+#endif
+			}
+			// The packet paths don't report their hits, so nothing of this tile can be reprojected
+			for (uint32_t y = 0; y < height && !jitter; y++)
+			{
+				for (uint32_t x = 0; x < width; x++)
+				{
+					m_Hits[xMin + x + (uint64_t)(yMin + y) * m_Target->GetWidth()] = PrimaryHit{};
+				}
+			}
 #else
+			// Directions for the whole tile at once, so ray setup is done eight rays at a time
+			std::array<float2, JobWidth * JobWidth> offsets;
+			std::array<float3, JobWidth * JobWidth> directions;
+			if (jitter)
+			{
+				for (float2& offset : offsets)
+				{
+					offset.x = _generator.NextFloat() - 0.5f;
+					offset.y = _generator.NextFloat() - 0.5f;
+				}
+			}
+			m_FrameCamera.ConstructDirections(xMin, yMin, JobWidth * JobWidth, jitter ? offsets.data() : nullptr, directions.data());
 
-				float3 color(0.0f);
-				color += m_Scene.Intersect(m_Camera.ConstructRay(jobID, _xMin, _yMin));
-
+			// The whole tile is one batch of paths, traced a bounce at a time. Reused by every tile this thread
+			// traces, so its queues stop growing after the first few tiles
+			thread_local Wavefront wavefront;
+			wavefront.Reset();
+			std::array<uint32_t, JobWidth * JobWidth> rays;
+			for (uint32_t jobID = 0; jobID < JobWidth * JobWidth; jobID++)
+			{
 				uint32_t x, y;
 				morton_to_xy(jobID, &x, &y);
-				output.Color[x + y * JobWidth] = color;
-#endif
+				// Pixels sticking out of the surface are never stored, so they aren't traced either
+				if (x >= width || y >= height)
+				{
+					continue;
+				}
+				const uint64_t pixel = xMin + x + (uint64_t)(yMin + y) * m_Target->GetWidth();
+				const Ray ray(m_FrameCamera.GetPosition(), directions[jobID]);
+				if (m_Relighting)
+				{
+					std::optional<Manifest> hit;
+					if (m_GBuffer[pixel].T < FLT_MAX)
+					{
+						hit = m_GBuffer[pixel];
+					}
+					rays[x + y * JobWidth] = wavefront.AddPrimaryRay(ray, hit);
+				}
+				else
+				{
+					rays[x + y * JobWidth] = wavefront.AddPrimaryRay(ray);
+				}
+			}
+			// Like the packet paths, a cancelled tile stops before anything of it was stored
+			if (!m_Scene.Trace(wavefront, _generator, m_FrameCancelled))
+			{
+				return;
+			}
+
+			for (uint32_t y = 0; y < height; y++)
+			{
+				for (uint32_t x = 0; x < width; x++)
+				{
+					const uint32_t ray = rays[x + y * JobWidth];
+					colors[x + y * JobWidth] = wavefront.GetColor(ray);
+					// Only the unjittered sample hits the point a reprojection expects for this pixel
+					if (!jitter)
+					{
+						const uint64_t pixel = xMin + x + (uint64_t)(yMin + y) * m_Target->GetWidth();
+						const std::optional<Manifest> hit = wavefront.GetHit(ray);
+						if (!m_Relighting)
+						{
+							m_GBuffer[pixel] = hit ? *hit : Manifest{};
+						}
+						m_Hits[pixel] = CreatePrimaryHit(hit);
+					}
+				}
+			}
 #endif
 
+			for (uint32_t y = 0; y < height; y++)
+			{
+				const uint64_t row = xMin + (uint64_t)(yMin + y) * m_Target->GetWidth();
+				float3* accumulated = &m_Accumulator[row];
+				float* luminanceSquares = &m_LuminanceSquares[row];
+				for (uint32_t x = 0; x < width; x++)
+				{
+					const float3& color = colors[x + y * JobWidth];
+					const float luminance = GetLuminance(color);
+					accumulated[x] = state.SampleCount == 0 ? color : accumulated[x] + color;
+					luminanceSquares[x] = state.SampleCount == 0 ? luminance * luminance
+						: luminanceSquares[x] + luminance * luminance;
+				}
 			}
-			return output;
-		};
-		return m_JobManager.AddJob(std::move(func));
+			state.SampleCount++;
+			state.Converged = m_AdaptiveSampling && IsTileConverged(xMin, yMin, state.SampleCount);
+			ResolveTile(xMin, yMin, state.SampleCount, colors);
+		}
+		PackTile(xMin, yMin, colors);
+	}
+
+	void Raytracer::SplatTile(uint32_t _tile, RandomGenerator&)
+	{
+		if (IsFrameCancelled())
+		{
+			return;
+		}
+		const uint32_t xMin = (_tile % m_TilesX) * JobWidth;
+		const uint32_t yMin = (_tile / m_TilesX) * JobWidth;
+		const uint32_t width = std::min(JobWidth, m_Target->GetWidth() - xMin);
+		const uint32_t height = std::min(JobWidth, m_Target->GetHeight() - yMin);
+
+		const float weight = 1.0f / std::max(1u, m_Tiles[_tile].SampleCount);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const uint64_t source = xMin + x + (uint64_t)(yMin + y) * m_Target->GetWidth();
+				m_HistoryColors[source] = m_Accumulator[source] * weight;
+
+				float2 pixel;
+				float depth;
+				const PrimaryHit& hit = m_HistoryHits[source];
+				// Pixels that can't be reused still splat, they have to hide what is behind them
+				if (!hit.Hit || !m_FrameCamera.Project(hit.Position, pixel, depth))
+				{
+					continue;
+				}
+
+				// Positive floats compare the same as their bits, so the nearest point has the smallest key
+				uint32_t depthBits;
+				std::memcpy(&depthBits, &depth, sizeof(depthBits));
+				const uint64_t key = ((uint64_t)depthBits << 32) | source;
+				const uint64_t target = uint64_t(pixel.x + 0.5f) + uint64_t(pixel.y + 0.5f) * m_Target->GetWidth();
+				std::atomic<uint64_t>& nearest = m_ReprojectionTargets[target];
+				uint64_t current = nearest.load(std::memory_order_relaxed);
+				while (key < current && !nearest.compare_exchange_weak(current, key, std::memory_order_relaxed))
+				{
+				}
+			}
+		}
+	}
+
+	void Raytracer::ReprojectTile(uint32_t _tile, RandomGenerator& _generator)
+	{
+		const uint32_t xMin = (_tile % m_TilesX) * JobWidth;
+		const uint32_t yMin = (_tile / m_TilesX) * JobWidth;
+		const uint32_t width = std::min(JobWidth, m_Target->GetWidth() - xMin);
+		const uint32_t height = std::min(JobWidth, m_Target->GetHeight() - yMin);
+
+		std::array<float3, JobWidth * JobWidth> colors;
+		uint32_t reprojected = 0;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			// Once per row, the targets left behind are cleared when the frame is abandoned
+			if (IsFrameCancelled())
+			{
+				return;
+			}
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const uint64_t pixel = xMin + x + (uint64_t)(yMin + y) * m_Target->GetWidth();
+				// Leaves the target empty for the next reprojection
+				const uint64_t key = m_ReprojectionTargets[pixel].exchange(EmptyReprojectionTarget, std::memory_order_relaxed);
+
+				float3 color;
+				const uint32_t source = uint32_t(key);
+				if (key != EmptyReprojectionTarget && m_HistoryHits[source].Reusable)
+				{
+					color = m_HistoryColors[source];
+					m_Hits[pixel] = m_HistoryHits[source];
+					reprojected++;
+				}
+				else
+				{
+					// Disoccluded, or the nearest point of the last frame looks different from here
+					std::optional<Manifest> hit;
+					color = m_Scene.Intersect(m_FrameCamera.ConstructRay(0, xMin + x, yMin + y), hit, _generator);
+					m_Hits[pixel] = CreatePrimaryHit(hit);
+				}
+
+				const float luminance = GetLuminance(color);
+				m_Accumulator[pixel] = color;
+				m_LuminanceSquares[pixel] = luminance * luminance;
+				colors[x + y * JobWidth] = color;
+			}
+		}
+
+		if (reprojected < width * height)
+		{
+			m_ActiveTiles.fetch_add(1, std::memory_order_relaxed);
+		}
+		m_ReprojectedPixels.fetch_add(reprojected, std::memory_order_relaxed);
+		PackTile(xMin, yMin, colors);
+	}
+
+	void Raytracer::CoarseTile(uint32_t _tile, RandomGenerator& _generator)
+	{
+		if (IsFrameCancelled())
+		{
+			return;
+		}
+		const uint32_t xMin = (_tile % m_TilesX) * JobWidth;
+		const uint32_t yMin = (_tile / m_TilesX) * JobWidth;
+		const uint32_t width = std::min(JobWidth, m_Target->GetWidth() - xMin);
+		const uint32_t height = std::min(JobWidth, m_Target->GetHeight() - yMin);
+
+		std::array<float3, JobWidth * JobWidth> colors;
+		float minLuminance = FLT_MAX;
+		float maxLuminance = 0.0f;
+		for (uint32_t yBlock = 0; yBlock < height; yBlock += CoarseBlockSize)
+		{
+			for (uint32_t xBlock = 0; xBlock < width; xBlock += CoarseBlockSize)
+			{
+				const float3 color = m_Scene.Intersect(m_FrameCamera.ConstructRay(0, xMin + xBlock, yMin + yBlock, float2((CoarseBlockSize - 1) * 0.5f)), _generator);
+				const float luminance = GetLuminance(color);
+				minLuminance = std::min(minLuminance, luminance);
+				maxLuminance = std::max(maxLuminance, luminance);
+
+				for (uint32_t y = yBlock; y < std::min(yBlock + CoarseBlockSize, height); y++)
+				{
+					for (uint32_t x = xBlock; x < std::min(xBlock + CoarseBlockSize, width); x++)
+					{
+						const uint64_t pixel = xMin + x + (uint64_t)(yMin + y) * m_Target->GetWidth();
+						m_Accumulator[pixel] = color;
+						m_LuminanceSquares[pixel] = luminance * luminance;
+						// The block's ray didn't hit the point behind this pixel, so there is nothing to reproject
+						m_Hits[pixel] = PrimaryHit{};
+						colors[x + y * JobWidth] = color;
+					}
+				}
+			}
+		}
+		m_TilePriorities[_tile] = maxLuminance - minLuminance;
+		PackTile(xMin, yMin, colors);
+	}
+
+	void Raytracer::RefineTile(uint32_t _tile, RandomGenerator& _generator)
+	{
+		if (m_FrameTimer.GetDuration() < m_FrameBudget)
+		{
+			RenderTile(_tile, _generator);
+		}
+	}
+
+	void Raytracer::PrepareDenoiseTile(uint32_t _tile, RandomGenerator&)
+	{
+		if (IsFrameCancelled())
+		{
+			return;
+		}
+		const uint32_t xMin = (_tile % m_TilesX) * JobWidth;
+		const uint32_t yMin = (_tile / m_TilesX) * JobWidth;
+		const uint32_t width = std::min(JobWidth, m_Target->GetWidth() - xMin);
+		const uint32_t height = std::min(JobWidth, m_Target->GetHeight() - yMin);
+
+		std::array<float3, JobWidth * JobWidth> colors;
+		std::array<Denoiser::Guide, JobWidth * JobWidth> guides;
+		ResolveTileGuides(_tile, colors, guides);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				m_Denoiser->SetPixel(xMin + x, yMin + y, colors[x + y * JobWidth], guides[x + y * JobWidth]);
+			}
+		}
+	}
+
+	void Raytracer::ResolveTileGuides(uint32_t _tile, std::array<float3, JobWidth * JobWidth>& _colors,
+		std::array<Denoiser::Guide, JobWidth * JobWidth>& _guides) const
+	{
+		const uint32_t xMin = (_tile % m_TilesX) * JobWidth;
+		const uint32_t yMin = (_tile / m_TilesX) * JobWidth;
+		const uint32_t width = std::min(JobWidth, m_Target->GetWidth() - xMin);
+		const uint32_t height = std::min(JobWidth, m_Target->GetHeight() - yMin);
+		const uint32_t sampleCount = m_Tiles[_tile].SampleCount;
+
+		ResolveTile(xMin, yMin, sampleCount, _colors);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const uint64_t pixel = xMin + x + (uint64_t)(yMin + y) * m_Target->GetWidth();
+				Denoiser::Guide& guide = _guides[x + y * JobWidth];
+				if (sampleCount >= MinAdaptiveSamples)
+				{
+					// Standard error of the pixel's mean, like the adaptive sampling estimates it
+					const float mean = GetLuminance(m_Accumulator[pixel]) / sampleCount;
+					guide.Deviation = std::sqrt(std::max(0.0f, m_LuminanceSquares[pixel] / sampleCount - mean * mean) / sampleCount);
+				}
+				else
+				{
+					// Too few samples for their own variance, the pixel's neighborhood within the tile stands in
+					float sum = 0.0f;
+					float squares = 0.0f;
+					uint32_t count = 0;
+					for (uint32_t ny = (y > 0 ? y - 1 : y); ny <= std::min(y + 1, height - 1); ny++)
+					{
+						for (uint32_t nx = (x > 0 ? x - 1 : x); nx <= std::min(x + 1, width - 1); nx++)
+						{
+							const float luminance = GetLuminance(_colors[nx + ny * JobWidth]);
+							sum += luminance;
+							squares += luminance * luminance;
+							count++;
+						}
+					}
+					const float mean = sum / count;
+					guide.Deviation = std::sqrt(std::max(0.0f, squares / count - mean * mean));
+				}
+
+				const Manifest& hit = m_GBuffer[pixel];
+				if (hit.T < FLT_MAX)
+				{
+					guide.Normal = hit.ShadingNormal;
+					guide.Depth = hit.T;
+					guide.Albedo = hit.M->Texture ? float3(hit.M->Texture->GetValue(hit.UV)) : hit.M->Color;
+				}
+				else
+				{
+					// Facing the camera, so neighboring misses agree on their normal
+					guide.Normal = -m_FrameCamera.ConstructRay(0, xMin + x, yMin + y).D;
+					guide.Depth = Denoiser::MissDepth;
+					guide.Albedo = float3(0.0f);
+				}
+			}
+		}
+	}
+
+	void Raytracer::DenoiseTile(uint32_t _tile, RandomGenerator&)
+	{
+		if (IsFrameCancelled())
+		{
+			return;
+		}
+		const uint32_t xMin = (_tile % m_TilesX) * JobWidth;
+		const uint32_t yMin = (_tile / m_TilesX) * JobWidth;
+		const uint32_t width = std::min(JobWidth, m_Target->GetWidth() - xMin);
+		const uint32_t height = std::min(JobWidth, m_Target->GetHeight() - yMin);
+		m_Denoiser->Filter(m_DenoiseIteration, xMin, yMin, width, height);
+
+		if (m_DenoiseIteration + 1 == m_DenoiseIterations)
+		{
+			std::array<float3, JobWidth * JobWidth> colors;
+			for (uint32_t y = 0; y < height; y++)
+			{
+				for (uint32_t x = 0; x < width; x++)
+				{
+					colors[x + y * JobWidth] = m_Denoiser->GetResult(m_DenoiseIterations, xMin + x, yMin + y);
+				}
+			}
+			PackTile(xMin, yMin, colors);
+		}
+	}
+
+	void Raytracer::PackTile(uint32_t _xMin, uint32_t _yMin, const std::array<float3, JobWidth * JobWidth>& _colors)
+	{
+		const uint32_t width = std::min(JobWidth, m_Target->GetWidth() - _xMin);
+		const uint32_t height = std::min(JobWidth, m_Target->GetHeight() - _yMin);
+		Pixel* destination = m_Target->GetBuffer() + _xMin + (uint64_t)_yMin * m_Target->GetWidth();
+		for (uint32_t y = 0; y < height; y++)
+		{
+			PackPixels(&_colors[y * JobWidth], destination + (uint64_t)y * m_Target->GetWidth(), width);
+		}
+	}
+
+	void Raytracer::ResolveTile(uint32_t _xMin, uint32_t _yMin, uint32_t _sampleCount, std::array<float3, JobWidth * JobWidth>& _colors) const
+	{
+		const uint32_t width = std::min(JobWidth, m_Target->GetWidth() - _xMin);
+		const uint32_t height = std::min(JobWidth, m_Target->GetHeight() - _yMin);
+		const float weight = 1.0f / std::max(1u, _sampleCount);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			const float3* accumulated = &m_Accumulator[_xMin + (uint64_t)(_yMin + y) * m_Target->GetWidth()];
+			for (uint32_t x = 0; x < width; x++)
+			{
+				_colors[x + y * JobWidth] = accumulated[x] * weight;
+			}
+		}
+	}
+
+	bool Raytracer::IsTileConverged(uint32_t _xMin, uint32_t _yMin, uint32_t _sampleCount) const
+	{
+		if (_sampleCount < MinAdaptiveSamples)
+		{
+			return false;
+		}
+		const uint32_t width = std::min(JobWidth, m_Target->GetWidth() - _xMin);
+		const uint32_t height = std::min(JobWidth, m_Target->GetHeight() - _yMin);
+		const float weight = 1.0f / _sampleCount;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			const uint64_t row = _xMin + (uint64_t)(_yMin + y) * m_Target->GetWidth();
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const float mean = GetLuminance(m_Accumulator[row + x]) * weight;
+				const float variance = std::max(0.0f, m_LuminanceSquares[row + x] * weight - mean * mean);
+				// Standard error of the pixel's mean, the whole tile has to be below the threshold
+				if (variance * weight > m_AdaptiveThreshold * m_AdaptiveThreshold)
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	void Raytracer::DispatchTiles(RandomGenerator& _generator)
+	{
+		const uint32_t nodeCount = uint32_t(m_NodeTiles.size());
+		const uint32_t homeNode = m_JobManager.GetCurrentNode();
+		for (uint32_t i = 0; i < nodeCount; i++)
+		{
+			NodeTiles& tiles = m_NodeTiles[(homeNode + i) % nodeCount];
+			for (uint32_t position = tiles.Next.fetch_add(1); position < tiles.End; position = tiles.Next.fetch_add(1))
+			{
+				(this->*m_TilePass)((*m_PassOrder)[position], _generator);
+			}
+		}
+		m_FrameBarrier.Arrive();
+	}
+
+	bool Raytracer::HasCameraMoved() const
+	{
+		return m_LastCameraPosition != m_Camera.GetPosition() || m_LastCameraFront != m_Camera.GetFront()
+			|| m_LastFieldOfView != m_Camera.GetFieldOfView();
+	}
+
+	Raytracer::PrimaryHit Raytracer::CreatePrimaryHit(const std::optional<Manifest>& _hit) const
+	{
+		if (!_hit)
+		{
+			return PrimaryHit{};
+		}
+		// Reflections, refractions and the BVH debug colors all change with the view direction
+		const bool reusable = _hit->M->type == Type::Basic && _hit->M->Specularity == 0.0f
+			&& m_Scene.GetBVHDebugSetting() == ETraversalDebugSetting::None;
+		return PrimaryHit{ _hit->IntersectionPoint, true, reusable };
 	}
 }
@@ -1,40 +1,269 @@
 #pragma once
 #include <./core/job_manager.h>
+#include <./core/frame_barrier.h>
 #include <cstdint>
 
 #include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <./core/random_generator.h>
+#include <./raytracing/camera.h>
+#include <./raytracing/manifest.h>
+#include <./raytracing/denoiser.h>
+#include <./benchmarking/timer.h>
 
 namespace CRT
 {
 	class Surface;
-	class Camera;
 	class Scene;
+	class Manifest;
+
+	enum class ERenderMode
+	{
+		/* A job with its own future per tile */
+		TileJobs,
+		/* One long running job per worker, claiming tiles from a shared counter */
+		PersistentWorkers
+	};
+
+	enum class ETileOrder
+	{
+		/* Left to right, top to bottom */
+		RowMajor,
+		/* Z-order curve, recursively by quadrant */
+		Morton,
+		/* Space filling curve without jumps, tiles traced at the same time stay close together */
+		Hilbert
+	};
 
 	class Raytracer
 	{
 	private:
 		constexpr static uint32_t JobWidth = 16;
+		// Rays traced between checks for a cancelled frame, within a tile
+		constexpr static uint32_t CancelCheckInterval = 32;
+		// Don't trust the variance estimate of a tile before it has this many samples
+		constexpr static uint32_t MinAdaptiveSamples = 4;
+		constexpr static uint64_t EmptyReprojectionTarget = UINT64_MAX;
+		// Pixels per side of the blocks that share a single ray in the coarse pass of a budgeted frame
+		constexpr static uint32_t CoarseBlockSize = 4;
 
-		struct JobOutput
+		struct TileState
 		{
-			uint32_t XMin;
-			uint32_t YMin;
-			std::array<float3, JobWidth* JobWidth> Color;
+			uint32_t SampleCount = 0;
+			// Estimated error dropped below the adaptive threshold, no new samples are needed
+			bool Converged = false;
 		};
 
+		struct PrimaryHit
+		{
+			float3 Position;
+			bool Hit = false;
+			// The shading of this point doesn't depend on the view direction, so other views can reuse its color
+			bool Reusable = false;
+		};
+
+		// Tiles claimed by the workers of one NUMA node. Every node gets a contiguous share of the tiles in
+		// proportion to its workers, and only helps out the other nodes once its own share ran out
+		struct alignas(64) NodeTiles
+		{
+			std::atomic<uint32_t> Next = 0;
+			uint32_t Begin = 0;
+			uint32_t End = 0;
+		};
+
+		using TilePass = void (Raytracer::*)(uint32_t, RandomGenerator&);
+
 	public:
-		Raytracer(Surface& _surface, const Scene& scene, const Camera& _camera);
+		// -1 threads leaves a few hardware threads free for the caller, like the windowed application needs.
+		// With NUMA affinity the scene's BVHs are also spread over the nodes' memory
+		Raytracer(Surface& _surface, const Scene& scene, const Camera& _camera, int _threadCount = -1,
+			EThreadAffinity _affinity = EThreadAffinity::None);
+		// Finishes the frame in flight before the dispatching thread stops
+		~Raytracer();
+		// Adds one sample per pixel to the accumulated image, starting over when the camera moved
 		void RenderFrame();
+		// Starts tracing the next frame into the target in the background and returns right away, e.g. to present
+		// the previous frame from another surface meanwhile. Camera changes after this call go into the next frame.
+		// The scene and the raytracer's settings must not change until WaitForFrame returned
+		void BeginFrame(Surface& _target);
+		// Returns false when the frame was cancelled, the target then holds an incomplete image
+		bool WaitForFrame();
+		// Tiles of the frame in flight that didn't start yet are dropped, started ones stop at their next check
+		void CancelFrame();
+		Timer::Duration GetFrameDuration() const;
+
+		// Has to be called when the scene changed, camera movement is picked up automatically
+		void ResetAccumulation();
+		// Lights or materials changed, but the camera and the geometry didn't. Starts the accumulation over like
+		// ResetAccumulation, but the first new sample shades the stored primary hits instead of tracing them again
+		void ResetLighting();
+		// Whether every tile reached the camera's anti aliasing sample count, or its error threshold
+		bool IsConverged() const;
+		// The accumulated rows [begin, end) without clamping them to the display range, e.g. to store them as HDR
+		void ResolveImage(std::vector<float3>& _image, uint32_t _yBegin = 0, uint32_t _yEnd = UINT32_MAX) const;
+		// The denoiser's guides of the accumulated rows [begin, end), so an image assembled from the rows of several
+		// renders can be filtered in one go. Returns false when the primary hits of the rows aren't known
+		bool ResolveDenoiseGuides(std::vector<Denoiser::Guide>& _guides, uint32_t _yBegin = 0, uint32_t _yEnd = UINT32_MAX) const;
+		// Only the rows of tiles in [begin, end) are rendered and checked for convergence, e.g. for the part of
+		// a frame a render node was assigned
+		void SetTileRows(uint32_t _begin, uint32_t _end);
+		uint32_t GetTileRowCount() const;
+		static constexpr uint32_t GetTileSize() { return JobWidth; }
+		uint32_t GetSampleCount() const;
+		uint32_t GetTileCount() const;
+		uint32_t GetActiveTileCount() const;
+
+		// Stops sampling tiles once the standard error of all their pixels is below the threshold
+		void SetAdaptiveSampling(bool _enabled);
+		bool IsAdaptiveSamplingEnabled() const;
+		void SetAdaptiveThreshold(float _threshold);
+		float GetAdaptiveThreshold() const;
+
+		// When the camera moves, warps the last frame into the new view and only traces the pixels it doesn't cover
+		void SetReprojection(bool _enabled);
+		bool IsReprojectionEnabled() const;
+		uint32_t GetReprojectedPixelCount() const;
+
+		// Frames after a camera move first trace a coarse preview, then refine the tiles with the most contrast
+		// until the budget is spent. The remaining tiles are traced once the camera stops. Zero turns it off
+		void SetFrameBudget(Timer::Duration _budget);
+		Timer::Duration GetFrameBudget() const;
+
+		void SetRenderMode(ERenderMode _renderMode);
+		ERenderMode GetRenderMode() const;
+
+		// Order tiles are handed to the workers in. Tiles traced at the same time share more of the BVH in the
+		// caches when they are close to each other on screen
+		void SetTileOrder(ETileOrder _tileOrder);
+		ETileOrder GetTileOrder() const;
+
+		// Filters every sample with the edge-avoiding denoiser before it is shown or resolved, guided by the
+		// primary hits. Zero iterations turn it off, every iteration doubles the radius of the filter
+		void SetDenoiseIterations(uint32_t _iterations);
+		uint32_t GetDenoiseIterations() const;
 	private:
-		std::future<JobOutput> CreateJob(uint32_t _xMin, uint32_t _yMin);
+		// Runs on the dispatching thread, traces every frame BeginFrame hands it until the raytracer is destroyed
+		void DispatchFrames();
+		void TraceFrame(bool _cameraMoved);
+		bool IsFrameCancelled() const;
+		// Leaves the raytracer in a state the next frame can continue from, after a pass was cut short
+		void AbandonFrame();
+		// Hands the tiles to the workers in the given order, of which only the current range of tiles is used
+		void RunTilePass(TilePass _pass, const std::vector<uint32_t>& _order);
+		void ResetTiles();
+		void SplitTilesOverNodes();
+		void UpdateTileSequence();
+		std::future<void> CreateJob(uint32_t _tile);
+		// Traces a tile and writes it straight into the surface, so no serial copy is needed afterwards
+		void RenderTile(uint32_t _tile, RandomGenerator& _generator);
+		// Resolves the tile's last frame into the history and splats its reusable pixels into the new view
+		void SplatTile(uint32_t _tile, RandomGenerator& _generator);
+		// Takes the nearest splatted pixel from the history, only tracing the holes
+		void ReprojectTile(uint32_t _tile, RandomGenerator& _generator);
+		// Traces one ray per coarse block and rates the tile by the contrast between its blocks
+		void CoarseTile(uint32_t _tile, RandomGenerator& _generator);
+		// Traces the tile unless the frame budget ran out, run in order of priority
+		void RefineTile(uint32_t _tile, RandomGenerator& _generator);
+		// Hands the tile's resolved colors and the guides of its primary hits to the denoiser
+		void PrepareDenoiseTile(uint32_t _tile, RandomGenerator& _generator);
+		// Resolves the tile's colors and the guides of its pixels for the denoiser
+		void ResolveTileGuides(uint32_t _tile, std::array<float3, JobWidth * JobWidth>& _colors,
+			std::array<Denoiser::Guide, JobWidth * JobWidth>& _guides) const;
+		// Runs the current iteration of the denoiser over the tile, the last one also writes it into the surface
+		void DenoiseTile(uint32_t _tile, RandomGenerator& _generator);
+		void PackTile(uint32_t _xMin, uint32_t _yMin, const std::array<float3, JobWidth * JobWidth>& _colors);
+		void ResolveTile(uint32_t _xMin, uint32_t _yMin, uint32_t _sampleCount, std::array<float3, JobWidth * JobWidth>& _colors) const;
+		bool IsTileConverged(uint32_t _xMin, uint32_t _yMin, uint32_t _sampleCount) const;
+		void DispatchTiles(RandomGenerator& _generator);
+		bool HasCameraMoved() const;
+		PrimaryHit CreatePrimaryHit(const std::optional<Manifest>& _hit) const;
 
 		Surface& m_Surface;
 		const Scene& m_Scene;
 		const Camera& m_Camera;
+		Camera m_FrameCamera;
+		Surface* m_Target;
 		JobManager<RandomGenerator> m_JobManager;
+		ERenderMode m_RenderMode = ERenderMode::PersistentWorkers;
 
 		// Saves a big allocation every frame
-		std::vector<std::future<JobOutput>> m_LastResults;
+		std::vector<std::future<void>> m_LastResults;
+
+		// Sum of all samples per pixel since the view last changed
+		std::vector<float3> m_Accumulator;
+		// Sum of the squared luminance of all samples, for the variance estimate
+		std::vector<float> m_LuminanceSquares;
+		std::vector<TileState> m_Tiles;
+		std::atomic<uint32_t> m_ActiveTiles = 0;
+		uint32_t m_SampleCount = 0;
+		bool m_AdaptiveSampling = true;
+		float m_AdaptiveThreshold = 0.005f;
+		float3 m_LastCameraPosition;
+		float3 m_LastCameraFront;
+		float m_LastFieldOfView = 0.0f;
+
+		// Primary hits of the current and the previous frame, swapped when reprojecting
+		std::vector<PrimaryHit> m_Hits;
+		std::vector<PrimaryHit> m_HistoryHits;
+		std::vector<float3> m_HistoryColors;
+		// Per pixel of the new view, the depth in the high and the source pixel in the low 32 bits, so the
+		// nearest splat wins an atomic min. Always empty outside of a reprojected frame
+		std::vector<std::atomic<uint64_t>> m_ReprojectionTargets;
+		std::atomic<uint32_t> m_ReprojectedPixels = 0;
+		bool m_Reprojection = true;
+		bool m_HistoryValid = false;
+
+		// Nearest hit of every pixel's unjittered primary ray, a miss has an infinite T. Valid while the view,
+		// the geometry and the range of tiles stay the same
+		std::vector<Manifest> m_GBuffer;
+		bool m_GBufferValid = false;
+		// This frame shades from the G-buffer instead of tracing primary rays
+		bool m_Relighting = false;
+
+		// Only allocated once denoising is turned on
+		std::unique_ptr<Denoiser> m_Denoiser;
+		uint32_t m_DenoiseIterations = 0;
+		// Iteration of the denoising pass in flight
+		uint32_t m_DenoiseIteration = 0;
+		// The denoiser holds the filtered result of the current samples
+		bool m_Denoised = false;
+
+		uint32_t m_TilesX;
+		uint32_t m_TilesY;
+		uint32_t m_TileBegin = 0;
+		uint32_t m_TileEnd = 0;
+		std::vector<NodeTiles> m_NodeTiles;
+		TilePass m_TilePass = &Raytracer::RenderTile;
+		const std::vector<uint32_t>* m_PassOrder = nullptr;
+		ETileOrder m_TileOrderType = ETileOrder::Hilbert;
+		// Tiles of the current range sorted along the tile order, every other tile at its own index
+		std::vector<uint32_t> m_TileSequence;
+		FrameBarrier m_FrameBarrier;
+		JobManager<RandomGenerator>::JobType m_TileWorker;
+		// Lets the scene stop tracing a tile of a cancelled frame between bounces, built once like the worker
+		std::function<bool()> m_FrameCancelled;
+
+		// Bumped by every cancel, a frame is cancelled once it no longer matches the generation it started with
+		std::atomic<uint32_t> m_Generation = 0;
+		uint32_t m_FrameGeneration = 0;
+		Timer m_FrameTimer;
+		Timer::Duration m_FrameDuration = Timer::Duration(0.0f);
+		Timer::Duration m_FrameBudget = Timer::Duration(0.0f);
+		std::vector<float> m_TilePriorities;
+		// The tile sequence, sorted by priority within every node's share
+		std::vector<uint32_t> m_TileOrder;
+		// Guards the hand over of frames between BeginFrame, WaitForFrame and the dispatching thread
+		std::mutex m_FrameMutex;
+		std::condition_variable m_FrameChanged;
+		bool m_FramePending = false;
+		bool m_FrameCameraMoved = false;
+		bool m_StopDispatching = false;
+		// Last member, it's started once everything it uses is constructed
+		std::thread m_Dispatcher;
 	};
 }
@@ -3,11 +3,14 @@
 
 #include <optional>
 #include <algorithm>
+#include <array>
+#include <cfloat>
 #include <cmath>
 
 namespace CRT
 {
 	const float3 Scene::BackgroundColor = float3(0.4f, 0.4f, 0.4f);
+	const float3 Scene::AmbientLight = float3(0.1f, 0.1f, 0.1f);
 
 	void Scene::AddShape(Shape* _shape, Material* _material)
 	{
@@ -35,9 +38,19 @@ namespace CRT
 		m_PointLights.emplace_back(std::move(_light));
 	}
 
-	float3 Scene::Intersect(Ray _r) const
+	std::vector<DirectionalLight>& Scene::GetDirectionalLights()
 	{
-		return IntersectBounced(_r, 5);
+		return m_DirectionalLights;
+	}
+
+	float3 Scene::Intersect(Ray _r, RandomGenerator& _generator) const
+	{
+		return IntersectBounced(_r, MaxBounces, Path{ _generator, float3::One() });
+	}
+
+	float3 Scene::Intersect(Ray _r, std::optional<Manifest>& _primaryHit, RandomGenerator& _generator) const
+	{
+		return IntersectBounced(_r, MaxBounces, Path{ _generator, float3::One() }, &_primaryHit);
 	}
 
 	void Scene::Intersect(const RayPacket& _r, float3* _ptr, int _id) const
@@ -45,6 +58,78 @@ namespace CRT
 		IntersectBounced(_r, _ptr, _id);
 	}
 
+	float3 Scene::Shade(Ray _r, const std::optional<Manifest>& _primaryHit, RandomGenerator& _generator) const
+	{
+		// Matches the first bounce of IntersectBounced without a debug setting
+		return _primaryHit ? RenderObject(_r, *_primaryHit, MaxBounces, Path{ _generator, float3::One() }) : BackgroundColor;
+	}
+
+	bool Scene::Trace(Wavefront& _wavefront, RandomGenerator& _generator, const std::function<bool()>& _cancelled) const
+	{
+		const auto isCancelled = [&_cancelled] { return _cancelled && _cancelled(); };
+		std::vector<Wavefront::PathRay>& rays = _wavefront.m_Rays;
+		if (m_DebugSetting != ETraversalDebugSetting::None)
+		{
+			// The debug colors come from the traversal of every single ray, which only the recursive tracer follows
+			for (uint32_t i = 0; i < uint32_t(rays.size()); i++)
+			{
+				if (isCancelled())
+				{
+					return false;
+				}
+				std::optional<Manifest> hit;
+				rays[i].Color = IntersectBounced(rays[i].Ray, MaxBounces, Path{ _generator, float3::One() }, &hit);
+				_wavefront.m_Hits[i] = hit ? *hit : Manifest{};
+			}
+			return true;
+		}
+
+		for (Wavefront::PathRay& ray : rays)
+		{
+			ray.RemainingBounces = MaxBounces;
+		}
+		// Every wave is one bounce of all paths that are still going, the rays they spawn are appended after it
+		uint32_t waveBegin = 0;
+		while (waveBegin < uint32_t(rays.size()))
+		{
+			const uint32_t waveEnd = uint32_t(rays.size());
+			ExtendWave(_wavefront, waveBegin, waveEnd);
+			if (isCancelled())
+			{
+				return false;
+			}
+			ShadeWave(_wavefront, waveBegin, waveEnd, _generator);
+			if (isCancelled())
+			{
+				return false;
+			}
+			TraceShadowRays(_wavefront, waveBegin, waveEnd);
+			if (isCancelled())
+			{
+				return false;
+			}
+			waveBegin = waveEnd;
+		}
+
+		// Rays always come after the ray that spawned them, so going backwards every ray has all of its own
+		// bounces added by the time it's added to its parent
+		for (uint32_t i = uint32_t(rays.size()); i-- > 0;)
+		{
+			const Wavefront::PathRay& ray = rays[i];
+			if (ray.Parent == Wavefront::NoParent)
+			{
+				continue;
+			}
+			float3 color = ray.Color / ray.Survival;
+			if (ray.AbsorptionDistance > 0.0f)
+			{
+				color = ApplyBeersLaw(color, ray.AbsorptionDistance);
+			}
+			rays[ray.Parent].Color += color * ray.Weight;
+		}
+		return true;
+	}
+
 	void Scene::EnableBVH()
 	{
 		m_UseBVH = true;
@@ -65,6 +150,56 @@ namespace CRT
 		return m_DebugSetting;
 	}
 
+	void Scene::SetPathTermination(EPathTermination _termination)
+	{
+		m_PathTermination = _termination;
+	}
+
+	EPathTermination Scene::GetPathTermination() const
+	{
+		return m_PathTermination;
+	}
+
+	void Scene::SetContributionThreshold(float _threshold)
+	{
+		m_ContributionThreshold = _threshold;
+	}
+
+	float Scene::GetContributionThreshold() const
+	{
+		return m_ContributionThreshold;
+	}
+
+	void Scene::SetSplitDepth(uint32_t _depth)
+	{
+		m_SplitDepth = _depth;
+	}
+
+	uint32_t Scene::GetSplitDepth() const
+	{
+		return m_SplitDepth;
+	}
+
+	void Scene::SetRaySorting(bool _enabled)
+	{
+		m_RaySorting = _enabled;
+	}
+
+	bool Scene::IsRaySortingEnabled() const
+	{
+		return m_RaySorting;
+	}
+
+	void Scene::SetTraversalMode(ETraversalMode _mode)
+	{
+		m_TraversalMode = _mode;
+	}
+
+	ETraversalMode Scene::GetTraversalMode() const
+	{
+		return m_TraversalMode;
+	}
+
 	bool Scene::IsBVHEnabled() const
 	{
 		return m_UseBVH;
@@ -80,6 +215,14 @@ namespace CRT
 		return triangleCount;
 	}
 
+	void Scene::InterleaveMemory() const
+	{
+		for (const auto& mesh : m_Meshes)
+		{
+			mesh->InterleaveMemory();
+		}
+	}
+
 	uint64_t Scene::GetBHVNodeCount() const
 	{
 		uint64_t nodeCount = 0ull;
@@ -90,7 +233,7 @@ namespace CRT
 		return nodeCount;
 	}
 
-	float3 Scene::IntersectBounced(Ray _r, unsigned _remainingBounces) const
+	float3 Scene::IntersectBounced(Ray _r, unsigned _remainingBounces, const Path& _path, std::optional<Manifest>* _primaryHit) const
 	{
 		if (_remainingBounces == 0)
 		{
@@ -98,6 +241,10 @@ namespace CRT
 		}
 		TraversalResult result = GetNearestIntersection(_r);
 		std::optional<Manifest> nearest = result.Manifest;
+		if (_primaryHit != nullptr)
+		{
+			*_primaryHit = nearest;
+		}
 
 		float3 debugColor = float3::Zero();
 		if (m_UseBVH)
@@ -108,7 +255,7 @@ namespace CRT
 
 		if (nearest && m_DebugSetting != ETraversalDebugSetting::TraversalOnly)
 		{
-			color = RenderObject(_r, *nearest, _remainingBounces);
+			color = RenderObject(_r, *nearest, _remainingBounces, _path);
 			if (m_DebugSetting == ETraversalDebugSetting::Blend)
 			{
 				color += debugColor;
@@ -177,28 +324,56 @@ namespace CRT
 		//}
 	}
 
-	float3 Scene::RenderObject(Ray _r, const Manifest& _manifest, unsigned _remainingBounces) const
+	float3 Scene::RenderObject(Ray _r, const Manifest& _manifest, unsigned _remainingBounces, const Path& _path) const
 	{
-		float3 object_color;
-		if (_manifest.M->Texture != nullptr)
-			object_color = _manifest.M->Texture->GetValue(_manifest.UV);
-		else
-			object_color = _manifest.M->Color;
-		float specularity = _manifest.M->Specularity;
+		const float3 object_color = GetObjectColor(_manifest);
+		std::array<Bounce, 2> bounces;
+		float diffuseness;
+		const uint32_t bounceCount = GetBounces(_r, _manifest, _remainingBounces, _path.Generator, bounces, diffuseness);
 
+		// Everything this point reflects is tinted by it
+		const float3 throughput = _path.Throughput * object_color;
 		float3 material_effect = float3::Zero();
+		for (uint32_t i = 0; i < bounceCount; i++)
+		{
+			float3 bounceColor = ContinuePath(bounces[i].Ray, _remainingBounces - 1, _path, throughput * bounces[i].Weight);
+			if (bounces[i].AbsorptionDistance > 0.0f)
+			{
+				bounceColor = ApplyBeersLaw(bounceColor, bounces[i].AbsorptionDistance);
+			}
+			material_effect += bounceColor * bounces[i].Weight;
+		}
+		if (diffuseness > 0.0f)
+		{
+			material_effect += GetTotalLightContribution(_manifest) * diffuseness;
+		}
+		return material_effect * object_color;
+	}
+
+	float3 Scene::GetObjectColor(const Manifest& _manifest) const
+	{
+		if (_manifest.M->Texture != nullptr)
+			return _manifest.M->Texture->GetValue(_manifest.UV);
+		return _manifest.M->Color;
+	}
+
+	uint32_t Scene::GetBounces(Ray _r, const Manifest& _manifest, unsigned _remainingBounces, RandomGenerator& _generator, std::array<Bounce, 2>& _bounces, float& _diffuseness) const
+	{
 		const float MinLightingComponent = 0.001f;
+		uint32_t bounceCount = 0;
+		_diffuseness = 0.0f;
 		if (_manifest.M->type == Type::Basic)
 		{
+			float specularity = _manifest.M->Specularity;
 			if (specularity > MinLightingComponent)
 			{
-				material_effect += GetReflectance(_r, _manifest, _remainingBounces) * specularity;
+				_bounces[bounceCount++] = Bounce{ GetReflectedRay(_r, _manifest), specularity, 0.0f };
 			}
 
 			float diffuseness = 1.0f - specularity;
 			if (diffuseness > MinLightingComponent)
 			{
-				material_effect += GetTotalLightContribution(_manifest) * diffuseness;
+				_diffuseness = diffuseness;
 			}
 		}
 		else if (_manifest.M->type == Type::Dielectric)
@@ -230,45 +405,176 @@ namespace CRT
 				// Fresnel
 				float sinIncoming = sqrtf(1.0f - cosIncoming * cosIncoming);
 				// Calculate from sin using Snell's law
-				float cosOutgoing = sqrtf(1.0f - std::powf((refractionIndexRatio * sinIncoming), 2));
-				float reflectanceSPolarized = std::powf((n1 * cosIncoming - n2 * cosOutgoing) /
-					(n1 * cosIncoming + n2 * cosOutgoing), 2);
-				float reflectancePPolarized = std::powf((n1 * cosOutgoing - n2 * cosIncoming) /
-					(n1 * cosOutgoing + n2 * cosIncoming), 2);
+				float cosOutgoing = sqrtf(1.0f - std::pow((refractionIndexRatio * sinIncoming), 2.0f));
+				float reflectanceSPolarized = std::pow((n1 * cosIncoming - n2 * cosOutgoing) /
+					(n1 * cosIncoming + n2 * cosOutgoing), 2.0f);
+				float reflectancePPolarized = std::pow((n1 * cosOutgoing - n2 * cosIncoming) /
+					(n1 * cosOutgoing + n2 * cosIncoming), 2.0f);
 				reflectance = 0.5f * (reflectanceSPolarized + reflectancePPolarized);
 			}
 			else
 			{
 				reflectance = 1.0f;
 			}
-			if (reflectance > MinLightingComponent)
+			float transmittance = 1.0f - reflectance;
+			// Past the split depth only one of the rays is traced, picked with the probability of its weight, so
+			// the weight and the probability cancel out
+			bool reflect = reflectance > MinLightingComponent;
+			bool transmit = transmittance > MinLightingComponent;
+			if (reflect && transmit && MaxBounces - _remainingBounces >= m_SplitDepth)
 			{
-				material_effect += GetReflectance(_r, _manifest, _remainingBounces) * reflectance;
+				reflect = _generator.NextFloat() < reflectance;
+				transmit = !reflect;
+				reflectance = reflect ? 1.0f : 0.0f;
+				transmittance = 1.0f - reflectance;
 			}
-			float transmittance = 1.0f - reflectance;
-			if (transmittance > MinLightingComponent)
+
+			if (reflect)
+			{
+				_bounces[bounceCount++] = Bounce{ GetReflectedRay(_r, _manifest), reflectance, 0.0f };
+			}
+			if (transmit)
 			{
 				float3 refractionDirection = refractionIndexRatio * _r.D +
-					normal * (refractionIndexRatio * cosIncoming - std::sqrtf(k));
+					normal * (refractionIndexRatio * cosIncoming - std::sqrt(k));
 
 				// Make sure the refraction ray doesn't self-intersect
 				const float SelfIntersectionDelta = 0.001f;
 				// Displace into opposite direction since we're moving into the new medium
 				const float3 Displacement = SelfIntersectionDelta * normal;
 
-				float3 transmittedColor = IntersectBounced(Ray(_manifest.IntersectionPoint - Displacement,
-					refractionDirection), _remainingBounces - 1);
-				if (!front_face)
+				// Leaving the object, the light of the bounce was absorbed on the way through it. Beer's law,
+				// divided by 5 to reduce the effect
+				_bounces[bounceCount++] = Bounce{ Ray(_manifest.IntersectionPoint - Displacement, refractionDirection),
+					transmittance, front_face ? 0.0f : _manifest.T / 5 };
+			}
+		}
+		return bounceCount;
+	}
+
+	void Scene::ExtendWave(Wavefront& _wavefront, uint32_t _begin, uint32_t _end) const
+	{
+		// The primary rays come in pixel order, which is as coherent as it gets already
+		const std::vector<uint32_t>* order = m_RaySorting && _begin > 0 ? &_wavefront.SortRays(_begin, _end) : nullptr;
+		std::vector<Ray>& batch = _wavefront.m_Batch;
+		std::vector<uint32_t>& owners = _wavefront.m_BatchOwners;
+		batch.clear();
+		owners.clear();
+		for (uint32_t i = 0; i < _end - _begin; i++)
+		{
+			const uint32_t index = order ? (*order)[i] : _begin + i;
+			const Wavefront::PathRay& ray = _wavefront.m_Rays[index];
+			if (ray.HitKnown || ray.RemainingBounces == 0)
+			{
+				continue;
+			}
+			if (m_TraversalMode != ETraversalMode::SingleRay)
+			{
+				batch.push_back(ray.Ray);
+				owners.push_back(index);
+			}
+			else
+			{
+				_wavefront.m_Hits[index] = GetNearestIntersection(ray.Ray).Manifest.value_or(Manifest{});
+			}
+		}
+
+		std::vector<std::optional<Manifest>>& hits = _wavefront.m_BatchHits;
+		hits.assign(batch.size(), std::nullopt);
+		GetNearestIntersections(batch.data(), uint32_t(batch.size()), hits.data());
+		for (uint32_t i = 0; i < uint32_t(batch.size()); i++)
+		{
+			_wavefront.m_Hits[owners[i]] = hits[i].value_or(Manifest{});
+		}
+	}
+
+	void Scene::ShadeWave(Wavefront& _wavefront, uint32_t _begin, uint32_t _end, RandomGenerator& _generator) const
+	{
+		std::vector<Wavefront::PathRay>& rays = _wavefront.m_Rays;
+		for (uint32_t i = _begin; i < _end; i++)
+		{
+			// Copied, spawning the next bounce can move the rays and hits
+			const Manifest hit = _wavefront.m_Hits[i];
+			if (rays[i].RemainingBounces == 0 || hit.T == FLT_MAX)
+			{
+				rays[i].Color = BackgroundColor;
+				continue;
+			}
+
+			const float3 objectColor = GetObjectColor(hit);
+			std::array<Bounce, 2> bounces;
+			float diffuseness;
+			const uint32_t bounceCount = GetBounces(rays[i].Ray, hit, rays[i].RemainingBounces, _generator, bounces, diffuseness);
+			if (diffuseness > 0.0f)
+			{
+				rays[i].Diffuse = objectColor * diffuseness;
+				rays[i].Irradiance = AmbientLight;
+				QueueShadowRays(_wavefront, i, hit, m_DirectionalLights);
+				QueueShadowRays(_wavefront, i, hit, m_SpotLights);
+				QueueShadowRays(_wavefront, i, hit, m_PointLights);
+			}
+
+			const float3 throughput = rays[i].Throughput * objectColor;
+			const unsigned remainingBounces = rays[i].RemainingBounces - 1;
+			for (uint32_t bounce = 0; bounce < bounceCount; bounce++)
+			{
+				const float3 bounceThroughput = throughput * bounces[bounce].Weight;
+				float survival;
+				if (SurvivesTermination(bounceThroughput, _generator, survival))
 				{
-					// Beer's law. Divided by 5 to reduce the effect
-					transmittedColor.x *= std::expf(-transmittedColor.x * (_manifest.T / 5));
-					transmittedColor.y *= std::expf(-transmittedColor.y * (_manifest.T / 5));
-					transmittedColor.z *= std::expf(-transmittedColor.z * (_manifest.T / 5));
+					_wavefront.AddRay(Wavefront::PathRay{ bounces[bounce].Ray, bounceThroughput / survival,
+						objectColor * bounces[bounce].Weight, float3::Zero(), float3::Zero(), float3::Zero(), i,
+						remainingBounces, survival, bounces[bounce].AbsorptionDistance, false });
 				}
-				material_effect += transmittedColor * transmittance;
 			}
 		}
-		return material_effect * object_color;
+	}
+
+	void Scene::TraceShadowRays(Wavefront& _wavefront, uint32_t _begin, uint32_t _end) const
+	{
+		std::vector<Wavefront::PathRay>& rays = _wavefront.m_Rays;
+		if (m_RaySorting)
+		{
+			_wavefront.SortShadowRays();
+		}
+		std::vector<std::optional<Manifest>>& blockers = _wavefront.m_BatchHits;
+		const bool batched = m_TraversalMode != ETraversalMode::SingleRay;
+		if (batched)
+		{
+			std::vector<Ray>& batch = _wavefront.m_Batch;
+			batch.clear();
+			for (const Wavefront::PendingShadowRay& shadowRay : _wavefront.m_ShadowRays)
+			{
+				batch.push_back(shadowRay.Ray.Ray);
+			}
+			blockers.assign(batch.size(), std::nullopt);
+			GetNearestIntersections(batch.data(), uint32_t(batch.size()), blockers.data());
+		}
+		for (uint32_t i = 0; i < uint32_t(_wavefront.m_ShadowRays.size()); i++)
+		{
+			const Wavefront::PendingShadowRay& shadowRay = _wavefront.m_ShadowRays[i];
+			const std::optional<Manifest> possible_blocker = batched ? blockers[i]
+				: GetNearestIntersection(shadowRay.Ray.Ray).Manifest;
+			if (!possible_blocker || possible_blocker->T >= shadowRay.Ray.MaxT)
+			{
+				rays[shadowRay.Owner].Irradiance += shadowRay.Contribution;
+			}
+		}
+		_wavefront.m_ShadowRays.clear();
+
+		// Clamped like GetTotalLightContribution does, which needs all lights of a hit first
+		for (uint32_t i = _begin; i < _end; i++)
+		{
+			rays[i].Color += rays[i].Irradiance.ComponentMin(float3::One()) * rays[i].Diffuse;
+		}
+	}
+
+	float3 Scene::ApplyBeersLaw(float3 _color, float _distance)
+	{
+		_color.x *= std::exp(-_color.x * _distance);
+		_color.y *= std::exp(-_color.y * _distance);
+		_color.z *= std::exp(-_color.z * _distance);
+		return _color;
 	}
 
 	TraversalResult Scene::GetNearestIntersection(Ray _ray) const
@@ -315,9 +621,38 @@ namespace CRT
 		return result;
 	}
 
+	void Scene::GetNearestIntersections(const Ray* _rays, uint32_t _count, std::optional<Manifest>* _nearest) const
+	{
+		if (!m_UseBVH)
+		{
+			for (uint32_t i = 0; i < _count; i++)
+			{
+				_nearest[i] = GetNearestIntersection(_rays[i]).Manifest;
+			}
+			return;
+		}
+
+		for (const auto& mesh : m_Meshes)
+		{
+			mesh->FindBVHIntersections(_rays, _count, _nearest, m_TraversalMode);
+		}
+		for (uint32_t i = 0; i < _count; i++)
+		{
+			for (uint32_t j = 0; j < m_Shapes.size(); j++)
+			{
+				Manifest manifest;
+				if (m_Shapes[j]->Intersect(_rays[i], manifest) && (!_nearest[i] || manifest.T < _nearest[i]->T))
+				{
+					manifest.M = m_Materials[j];
+					_nearest[i] = manifest;
+				}
+			}
+		}
+	}
+
 	float3 Scene::GetTotalLightContribution(const Manifest& _manifest) const
 	{
-		float3 totalLightContribution = { 0.1f, 0.1f, 0.1f };
+		float3 totalLightContribution = AmbientLight;
 		for (const DirectionalLight& directionalLight : m_DirectionalLights)
 		{
 			totalLightContribution += GetLightContribution(_manifest, directionalLight);
@@ -335,7 +670,34 @@ namespace CRT
 				std::min(totalLightContribution.z, 1.0f) };
 	}
 
-	float3 Scene::GetReflectance(Ray _r, const Manifest& _manifest, unsigned _remainingBounces) const
+	float3 Scene::ContinuePath(Ray _r, unsigned _remainingBounces, const Path& _path, const float3& _throughput) const
+	{
+		float survival;
+		if (!SurvivesTermination(_throughput, _path.Generator, survival))
+		{
+			return float3::Zero();
+		}
+		return IntersectBounced(_r, _remainingBounces, Path{ _path.Generator, _throughput / survival }) / survival;
+	}
+
+	bool Scene::SurvivesTermination(const float3& _throughput, RandomGenerator& _generator, float& _survival) const
+	{
+		_survival = 1.0f;
+		const float contribution = std::max(_throughput.x, std::max(_throughput.y, _throughput.z));
+		if (m_PathTermination == EPathTermination::FixedDepth || contribution >= m_ContributionThreshold)
+		{
+			return true;
+		}
+		if (m_PathTermination == EPathTermination::ContributionThreshold)
+		{
+			return false;
+		}
+		// Survivors carry the ended paths as well, which brings them back up to the threshold
+		_survival = contribution / m_ContributionThreshold;
+		return _generator.NextFloat() < _survival;
+	}
+
+	Ray Scene::GetReflectedRay(Ray _r, const Manifest& _manifest) const
 	{
 		// Make sure the refraction ray doesn't self-intersect
 		const float SelfIntersectionDelta = 0.001f;
@@ -344,6 +706,6 @@ namespace CRT
 
 		Ray reflectedRay = _r.Reflect(_manifest.ShadingNormal);
 		reflectedRay.O = _manifest.IntersectionPoint + Displacement;
-		return IntersectBounced(reflectedRay, _remainingBounces - 1);
+		return reflectedRay;
 	}
 }
@@ -10,7 +10,11 @@
 #include "./raytracing/lights/point_light.h"
 #include "./raytracing/bvh.h"
 #include <./raytracing/shapes/mesh.h>
+#include <./core/random_generator.h>
+#include <./raytracing/wavefront.h>
 
+#include <array>
+#include <functional>
 #include <vector>
 #include <optional>
 #include <memory>
@@ -30,6 +34,17 @@ namespace CRT
 		TraversalOnly
 	};
 
+	enum class EPathTermination
+	{
+		/* Every ray is followed until the bounce limit */
+		FixedDepth,
+		/* Rays that would add less than the threshold to the pixel aren't traced, which darkens the image slightly */
+		ContributionThreshold,
+		/* Rays below the threshold are traced with a probability in proportion to their contribution, and weighted
+		   up by it when they survive, so on average the image stays the same */
+		RussianRoulette
+	};
+
 	class Scene
 	{
 	public:
@@ -40,25 +55,94 @@ namespace CRT
 		void AddDirectionalLight(DirectionalLight _light);
 		void AddSpotLight(SpotLight _light);
 		void AddPointLight(PointLight _light);
+		// For editing the lights in place, only the shading of the scene depends on them
+		std::vector<DirectionalLight>& GetDirectionalLights();
 
-		float3 Intersect(Ray _r) const;
+		// The generator makes the stochastic path decisions, when the path termination or the splitting needs any
+		float3 Intersect(Ray _r, RandomGenerator& _generator) const;
+		// Also hands out the primary hit, e.g. to reuse the shading of that point from another view
+		float3 Intersect(Ray _r, std::optional<Manifest>& _primaryHit, RandomGenerator& _generator) const;
 		void Intersect(const RayPacket& _r, float3* _ptr, int _id) const;
+		// Same color as Intersect for a ray whose nearest hit is already known, only the shading and the rays
+		// it spawns are traced. Doesn't draw the BVH debug settings, those need the primary traversal
+		float3 Shade(Ray _r, const std::optional<Manifest>& _primaryHit, RandomGenerator& _generator) const;
+		// Same colors as Intersect for every primary ray of the batch, with Shade for the ones with a known hit,
+		// but traced one bounce of all paths at a time. The optional predicate is checked between the stages of
+		// every bounce, once it returns true the tracing stops and false is returned, the colors are incomplete then
+		bool Trace(Wavefront& _wavefront, RandomGenerator& _generator, const std::function<bool()>& _cancelled = nullptr) const;
 
 		void EnableBVH();
 		void DisableBVH();
 		void SetBVHDebugSetting(ETraversalDebugSetting _debugSetting);
 		ETraversalDebugSetting GetBVHDebugSetting() const;
+		void SetPathTermination(EPathTermination _termination);
+		EPathTermination GetPathTermination() const;
+		// Contribution to the pixel, relative to the primary ray, below which a path may end
+		void SetContributionThreshold(float _threshold);
+		float GetContributionThreshold() const;
+		// Dielectrics hit within this many bounces trace both the reflected and the refracted ray, deeper ones
+		// pick one of them by the Fresnel term. The default always splits
+		void SetSplitDepth(uint32_t _depth);
+		uint32_t GetSplitDepth() const;
+		// Traces the secondary and shadow rays of a wavefront grouped by direction and origin instead of by pixel,
+		// so consecutive rays share more of the BVH in the caches. Doesn't change the image
+		void SetRaySorting(bool _enabled);
+		bool IsRaySortingEnabled() const;
+		// How the BVHs are traversed by the rays of a wavefront, which doesn't change the image
+		void SetTraversalMode(ETraversalMode _mode);
+		ETraversalMode GetTraversalMode() const;
 		bool IsBVHEnabled() const;
 		uint64_t GetTriangleCount() const;
+		// Spreads the BVHs over the memory of all NUMA nodes, without changing anything about the scene
+		void InterleaveMemory() const;
 		uint64_t GetBHVNodeCount() const;
 	private:
-		float3 IntersectBounced(Ray _r, unsigned _remainingBounces) const;
+		constexpr static unsigned MaxBounces = 5;
+
+		// What the bounces of a path need to know about the path so far
+		struct Path
+		{
+			RandomGenerator& Generator;
+			// Fraction of a ray's color that ends up in the pixel
+			float3 Throughput;
+		};
+
+		float3 IntersectBounced(Ray _r, unsigned _remainingBounces, const Path& _path, std::optional<Manifest>* _primaryHit = nullptr) const;
 		void IntersectBounced(const RayPacket& _r, float3* _ptr, int _id) const;
-		float3 RenderObject(Ray _r, const Manifest& _manifest, unsigned _remainingBounces) const;
+		// A ray a hit spawns, with the fraction of the hit's color it carries
+		struct Bounce
+		{
+			// Rays have no default, but the bounces are collected in an array
+			CRT::Ray Ray = CRT::Ray(float3::Zero(), float3::Zero());
+			float Weight;
+			// Distance the bounce's light travels through a dielectric, for Beer's law. Zero when it doesn't
+			float AbsorptionDistance;
+		};
+
+		float3 RenderObject(Ray _r, const Manifest& _manifest, unsigned _remainingBounces, const Path& _path) const;
+		float3 GetObjectColor(const Manifest& _manifest) const;
+		// The rays a hit spawns, and how much of it is lit directly instead. Returns the number of bounces
+		uint32_t GetBounces(Ray _r, const Manifest& _manifest, unsigned _remainingBounces, RandomGenerator& _generator,
+			std::array<Bounce, 2>& _bounces, float& _diffuseness) const;
+		static float3 ApplyBeersLaw(float3 _color, float _distance);
+		// Finds the nearest hits of the wave's rays
+		void ExtendWave(Wavefront& _wavefront, uint32_t _begin, uint32_t _end) const;
+		// Lets the wave's hits queue their shadow rays and spawn the next wave
+		void ShadeWave(Wavefront& _wavefront, uint32_t _begin, uint32_t _end, RandomGenerator& _generator) const;
+		// Traces the queued shadow rays and adds the direct light of the wave's hits
+		void TraceShadowRays(Wavefront& _wavefront, uint32_t _begin, uint32_t _end) const;
+		// Traces a secondary ray with the given throughput, or ends the path there. Returns the ray's color,
+		// already weighted up for the paths of the same kind that were ended
+		float3 ContinuePath(Ray _r, unsigned _remainingBounces, const Path& _path, const float3& _throughput) const;
 
 		TraversalResult GetNearestIntersection(Ray _ray) const;
+		// The nearest hits of a batch of rays, with the meshes traversed in the batch traversal mode
+		void GetNearestIntersections(const Ray* _rays, uint32_t _count, std::optional<Manifest>* _nearest) const;
 		float3 GetTotalLightContribution(const Manifest& _manifest) const;
-		float3 GetReflectance(Ray _r, const Manifest& _manifest, unsigned _remainingBounces) const;
+		// Whether a ray with the given throughput is traced, and with which probability. Its color has to be
+		// divided by that probability
+		bool SurvivesTermination(const float3& _throughput, RandomGenerator& _generator, float& _survival) const;
+		Ray GetReflectedRay(Ray _r, const Manifest& _manifest) const;
 
 		template<typename TLight>
 		float3 GetLightContribution(const Manifest& _manifest, const TLight& _light) const
@@ -76,7 +160,21 @@ namespace CRT
 			return 0.0f;
 		}
 
+		template<typename TLight>
+		void QueueShadowRays(Wavefront& _wavefront, uint32_t _owner, const Manifest& _manifest, const std::vector<TLight>& _lights) const
+		{
+			for (const TLight& light : _lights)
+			{
+				auto contribution = light.GetLightContribution(_manifest);
+				if (contribution > 0.001f)
+				{
+					_wavefront.m_ShadowRays.push_back({ light.ConstructShadowRay(_manifest), contribution, _owner });
+				}
+			}
+		}
+
 		const static float3 BackgroundColor;
+		const static float3 AmbientLight;
 
 		std::vector<std::unique_ptr<Mesh>> m_Meshes;
 		std::vector<Shape*>    m_Shapes;
@@ -86,5 +184,10 @@ namespace CRT
 		std::vector<DirectionalLight> m_DirectionalLights;
 		ETraversalDebugSetting m_DebugSetting = ETraversalDebugSetting::None;
 		bool m_UseBVH = true;
+		EPathTermination m_PathTermination = EPathTermination::FixedDepth;
+		float m_ContributionThreshold = 0.05f;
+		uint32_t m_SplitDepth = UINT32_MAX;
+		bool m_RaySorting = false;
+		ETraversalMode m_TraversalMode = ETraversalMode::Packets;
 	};
 }
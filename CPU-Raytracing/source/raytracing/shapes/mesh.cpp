@@ -1,4 +1,4 @@
-#include "Mesh.h"
+#include "mesh.h"
 
 namespace CRT
 {
@@ -19,6 +19,30 @@ namespace CRT
 		return result;
 	}
 		
+	void Mesh::FindBVHIntersections(const Ray* _rays, uint32_t _count, std::optional<Manifest>* _nearest, ETraversalMode _mode) const
+	{
+		if (_mode == ETraversalMode::Treelets)
+		{
+			m_BVH.GetNearestIntersectionsByTreelet(_rays, _count, _nearest);
+		}
+		else if (_mode == ETraversalMode::Packets)
+		{
+			m_BVH.GetNearestIntersectionsInPackets(_rays, _count, _nearest);
+		}
+		else
+		{
+			m_BVH.GetNearestIntersections(_rays, _count, _nearest);
+		}
+		// The hits that were nearer before keep the material of their mesh
+		for (uint32_t i = 0; i < _count; i++)
+		{
+			if (_nearest[i] && !_nearest[i]->M)
+			{
+				_nearest[i]->M = m_Material;
+			}
+		}
+	}
+
 	std::optional<Manifest> Mesh::FindIntersection(const Ray& _ray) const
 	{
 		std::optional<Manifest> nearest;
@@ -44,4 +68,9 @@ namespace CRT
 	{
 		return m_BVH.GetNodeCount();
 	}
+
+	void Mesh::InterleaveMemory() const
+	{
+		m_BVH.InterleaveMemory();
+	}
 }
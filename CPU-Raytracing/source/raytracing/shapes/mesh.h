@@ -12,9 +12,12 @@ namespace CRT
 		Mesh(std::vector<Triangle> _triangles, Material* _material);
 
 		TraversalResult FindBVHIntersection(const Ray& _ray) const;
+		// Replaces the nearest hits of the rays with the mesh's hits that are nearer, with one of the batch traversals
+		void FindBVHIntersections(const Ray* _rays, uint32_t _count, std::optional<Manifest>* _nearest, ETraversalMode _mode) const;
 		std::optional<Manifest> FindIntersection(const Ray& _ray) const;
 		uint64_t GetTriangleCount() const;
 		uint64_t GetBVHNodeCount() const;
+		void InterleaveMemory() const;
 	private:
 		BVH m_BVH;
 		std::vector<Triangle> m_Triangles;
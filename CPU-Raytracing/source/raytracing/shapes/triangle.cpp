@@ -70,6 +70,12 @@ namespace CRT
 
     bool Triangle::IntersectDisplaced(Ray _r, Manifest& _m, const Texture* _heightmap) const
     {
+        // Materials without a heightmap, e.g. every mesh loaded without one, are just flat triangles
+        if (_heightmap == nullptr)
+        {
+            return Intersect(_r, _m);
+        }
+
         std::array<Triangle, 4> triangles;
         //(A*a + B*b + C*c) / (a + b + c)
         {
@@ -0,0 +1,115 @@
+#include "./raytracing/wavefront.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace CRT
+{
+	namespace
+	{
+		// Cells per axis of the grid the origins are snapped to, the three Morton coordinates and the octant
+		// fill the 32 bits of a key
+		constexpr uint32_t OriginCells = 1u << 9;
+
+		template<typename TGetRay>
+		void SortByCoherence(std::vector<uint64_t>& _keys, uint32_t _count, TGetRay _getRay)
+		{
+			// The grid only spans the origins of this batch, so even a small batch spreads over all of its cells
+			float3 minimum(FLT_MAX);
+			float3 maximum(-FLT_MAX);
+			for (uint32_t i = 0; i < _count; i++)
+			{
+				const float3& origin = _getRay(i).O;
+				minimum = float3(std::min(minimum.x, origin.x), std::min(minimum.y, origin.y), std::min(minimum.z, origin.z));
+				maximum = float3(std::max(maximum.x, origin.x), std::max(maximum.y, origin.y), std::max(maximum.z, origin.z));
+			}
+			const float3 extent = maximum - minimum;
+			const float cells = float(OriginCells - 1);
+			const float3 scale(extent.x > 0.0f ? cells / extent.x : 0.0f, extent.y > 0.0f ? cells / extent.y : 0.0f,
+				extent.z > 0.0f ? cells / extent.z : 0.0f);
+
+			_keys.resize(_count);
+			for (uint32_t i = 0; i < _count; i++)
+			{
+				const Ray& ray = _getRay(i);
+				const uint32_t octant = uint32_t(ray.D.x < 0.0f) | uint32_t(ray.D.y < 0.0f) << 1 | uint32_t(ray.D.z < 0.0f) << 2;
+				const float3 cell = (ray.O - minimum) * scale;
+				const uint32_t key = octant << 27 | xyz_to_morton(uint32_t(cell.x), uint32_t(cell.y), uint32_t(cell.z));
+				_keys[i] = (uint64_t)key << 32 | i;
+			}
+			std::sort(_keys.begin(), _keys.end());
+		}
+	}
+
+	void Wavefront::Reset()
+	{
+		m_Rays.clear();
+		m_Hits.clear();
+		m_ShadowRays.clear();
+	}
+
+	uint32_t Wavefront::AddPrimaryRay(const Ray& _ray)
+	{
+		return AddRay(PathRay{ _ray, float3::One(), float3::One(), float3::Zero(), float3::Zero(), float3::Zero(),
+			NoParent, 0, 1.0f, 0.0f, false });
+	}
+
+	uint32_t Wavefront::AddPrimaryRay(const Ray& _ray, const std::optional<Manifest>& _hit)
+	{
+		const uint32_t index = AddRay(PathRay{ _ray, float3::One(), float3::One(), float3::Zero(), float3::Zero(),
+			float3::Zero(), NoParent, 0, 1.0f, 0.0f, true });
+		if (_hit)
+		{
+			m_Hits[index] = *_hit;
+		}
+		return index;
+	}
+
+	float3 Wavefront::GetColor(uint32_t _ray) const
+	{
+		return m_Rays[_ray].Color;
+	}
+
+	std::optional<Manifest> Wavefront::GetHit(uint32_t _ray) const
+	{
+		if (m_Hits[_ray].T < FLT_MAX)
+		{
+			return m_Hits[_ray];
+		}
+		return std::nullopt;
+	}
+
+	uint32_t Wavefront::GetRayCount() const
+	{
+		return uint32_t(m_Rays.size());
+	}
+
+	const std::vector<uint32_t>& Wavefront::SortRays(uint32_t _begin, uint32_t _end)
+	{
+		SortByCoherence(m_SortKeys, _end - _begin, [this, _begin](uint32_t _i) -> const Ray& { return m_Rays[_begin + _i].Ray; });
+		m_Order.resize(m_SortKeys.size());
+		for (uint32_t i = 0; i < uint32_t(m_SortKeys.size()); i++)
+		{
+			m_Order[i] = _begin + uint32_t(m_SortKeys[i]);
+		}
+		return m_Order;
+	}
+
+	void Wavefront::SortShadowRays()
+	{
+		SortByCoherence(m_SortKeys, uint32_t(m_ShadowRays.size()), [this](uint32_t _i) -> const Ray& { return m_ShadowRays[_i].Ray.Ray; });
+		m_SortedShadowRays.clear();
+		for (uint64_t key : m_SortKeys)
+		{
+			m_SortedShadowRays.push_back(m_ShadowRays[uint32_t(key)]);
+		}
+		std::swap(m_ShadowRays, m_SortedShadowRays);
+	}
+
+	uint32_t Wavefront::AddRay(const PathRay& _ray)
+	{
+		m_Rays.push_back(_ray);
+		m_Hits.emplace_back();
+		return uint32_t(m_Rays.size() - 1);
+	}
+}
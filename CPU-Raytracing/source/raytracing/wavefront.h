@@ -0,0 +1,85 @@
+#pragma once
+#include "./core/math/float3.h"
+#include "./raytracing/ray.h"
+#include "./raytracing/manifest.h"
+#include "./raytracing/lights/light.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace CRT
+{
+	// The paths of a batch of primary rays, traced one bounce at a time for all of them instead of one path
+	// after the other. Every bounce runs in stages over the whole batch: extend finds the nearest hits, shade
+	// queues the shadow rays and spawns the next bounce, and then the shadow rays are traced together.
+	// Once no path has a bounce left, the colors are gathered back up the paths
+	class Wavefront
+	{
+	public:
+		// Starts a new batch, keeping the allocations
+		void Reset();
+		// Returns the index of the ray, its color and hit are at the same index once the batch is traced
+		uint32_t AddPrimaryRay(const Ray& _ray);
+		// For a ray whose nearest hit is known already, e.g. from a G-buffer, the extend stage skips it
+		uint32_t AddPrimaryRay(const Ray& _ray, const std::optional<Manifest>& _hit);
+		float3 GetColor(uint32_t _ray) const;
+		std::optional<Manifest> GetHit(uint32_t _ray) const;
+		uint32_t GetRayCount() const;
+
+	private:
+		friend class Scene;
+		constexpr static uint32_t NoParent = UINT32_MAX;
+
+		struct PathRay
+		{
+			CRT::Ray Ray;
+			// Fraction of this ray's color that ends up in the pixel, for the path termination
+			float3 Throughput;
+			// Factor on this ray's color when it's added to the ray that spawned it
+			float3 Weight;
+			// Light this ray gathered itself, the light of its children is added once the batch is done
+			float3 Color;
+			// Direct light at the hit, summed over the shadow rays and clamped once they are all traced
+			float3 Irradiance;
+			// Tint of the direct light, zero for hits that don't scatter any
+			float3 Diffuse;
+			uint32_t Parent;
+			// Primary rays get the scene's bounce limit once the batch is traced
+			unsigned RemainingBounces;
+			// Probability this ray survived the path termination with, its color is divided by it
+			float Survival;
+			// Distance the ray's color traveled through a dielectric, absorbed by Beer's law. Zero for none
+			float AbsorptionDistance;
+			bool HitKnown;
+		};
+
+		struct PendingShadowRay
+		{
+			ShadowRay Ray;
+			float3 Contribution;
+			uint32_t Owner;
+		};
+
+		uint32_t AddRay(const PathRay& _ray);
+		// Order to trace the rays [begin, end) in: grouped by the octant of their direction, and within it along
+		// a Morton curve through their origins, so rays traced one after another visit the same BVH nodes
+		const std::vector<uint32_t>& SortRays(uint32_t _begin, uint32_t _end);
+		// Same order for the queued shadow rays, which are sorted in place
+		void SortShadowRays();
+
+		std::vector<PathRay> m_Rays;
+		// Nearest hit of every ray, a miss has an infinite T
+		std::vector<Manifest> m_Hits;
+		// Shadow rays of the current bounce
+		std::vector<PendingShadowRay> m_ShadowRays;
+		std::vector<PendingShadowRay> m_SortedShadowRays;
+		std::vector<uint32_t> m_Order;
+		// Sort key in the high and the ray in the low 32 bits
+		std::vector<uint64_t> m_SortKeys;
+		// Rays handed to the batch traversal together, with the ray each one belongs to and its nearest hit
+		std::vector<Ray> m_Batch;
+		std::vector<uint32_t> m_BatchOwners;
+		std::vector<std::optional<Manifest>> m_BatchHits;
+	};
+}
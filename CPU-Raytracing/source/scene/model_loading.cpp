@@ -3,14 +3,92 @@
 #include "./raytracing/bvh.h"
 #include "./raytracing/shapes/mesh.h"
 
+// Builds without assimp, e.g. the headless renderer on machines that don't have it, only load OBJ files
+#if defined(CRT_NO_ASSIMP)
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+#else
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#endif
 
 #include <iostream>
 
 namespace CRT
 {
+#if defined(CRT_NO_ASSIMP)
+	void ModelLoading::LoadModel(Scene* _scene, Material* material, float3 _offset, const std::string& _filepath)
+	{
+		tinyobj::attrib_t attributes;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string warning;
+		std::string error;
+		if (!tinyobj::LoadObj(&attributes, &shapes, &materials, &warning, &error, _filepath.c_str()))
+		{
+			std::cout << "Error while loading mesh: " << error << "\n";
+			return;
+		}
+
+		const auto getPosition = [&attributes](const tinyobj::index_t& _index)
+		{
+			return float3(attributes.vertices[3 * _index.vertex_index + 0],
+				attributes.vertices[3 * _index.vertex_index + 1],
+				attributes.vertices[3 * _index.vertex_index + 2]);
+		};
+		const auto getUV = [&attributes](const tinyobj::index_t& _index)
+		{
+			if (_index.texcoord_index < 0)
+			{
+				return float2(0.0f, 0.0f);
+			}
+			return float2(attributes.texcoords[2 * _index.texcoord_index + 0], attributes.texcoords[2 * _index.texcoord_index + 1]);
+		};
+
+		std::vector<Triangle> triangles;
+		for (const tinyobj::shape_t& shape : shapes)
+		{
+			const std::vector<tinyobj::index_t>& indices = shape.mesh.indices;
+			triangles.reserve(triangles.size() + indices.size() / 3);
+			// LoadObj triangulates, so every face has three indices
+			for (size_t j = 0; j + 2 < indices.size(); j += 3)
+			{
+				float3 pos0 = getPosition(indices[j]);
+				float3 pos1 = getPosition(indices[j + 1]);
+				float3 pos2 = getPosition(indices[j + 2]);
+
+				float3 n[3];
+				for (int k = 0; k < 3; k++)
+				{
+					const int normalIndex = indices[j + k].normal_index;
+					if (normalIndex >= 0)
+					{
+						n[k] = float3(attributes.normals[3 * normalIndex + 0], attributes.normals[3 * normalIndex + 1], attributes.normals[3 * normalIndex + 2]);
+					}
+					else
+					{
+						// Assimp generates these for us
+						n[k] = (pos1 - pos0).Cross(pos2 - pos0).Normalize();
+					}
+				}
+
+				triangles.emplace_back(
+					pos0 + _offset,
+					pos1 + _offset,
+					pos2 + _offset,
+					getUV(indices[j]),
+					getUV(indices[j + 1]),
+					getUV(indices[j + 2]),
+					n[0],
+					n[1],
+					n[2]
+					);
+			}
+		}
+		_scene->AddMesh(Mesh(std::move(triangles), material));
+	}
+#else
 	void ModelLoading::LoadModel(Scene* _scene, Material* material, float3 _offset, const std::string& _filepath)
 	{
 		Assimp::Importer importer;
@@ -90,4 +168,5 @@ namespace CRT
 		}
 		_scene->AddMesh(Mesh(std::move(triangles), material));
 	}
+#endif
 }
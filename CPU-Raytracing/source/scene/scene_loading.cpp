@@ -0,0 +1,119 @@
+#include "./scene/scene_loading.h"
+#include "./scene/model_loading.h"
+
+#include "./core/graphics/color3.h"
+#include "./core/math/trigonometry.h"
+#include "./raytracing/shapes/mesh.h"
+#include "./raytracing/shapes/plane.h"
+#include "./raytracing/shapes/sphere.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <vector>
+
+namespace CRT
+{
+	namespace
+	{
+		// Rings of latitude of the tessellated spheres, every ring has twice as many segments
+		constexpr uint32_t SphereRings = 16;
+		// Spheres per side of the grid in the mirror and glass scenes
+		constexpr uint32_t SphereGridSize = 5;
+
+		const char* const BuiltinScene = "builtin";
+		const char* const MirrorScene = "builtin-mirrors";
+		const char* const GlassScene = "builtin-glass";
+		const char* const BuiltinScenes[] = { BuiltinScene, MirrorScene, GlassScene };
+
+		void AddSphereTriangles(std::vector<Triangle>& _triangles, const float3& _center, float _radius)
+		{
+			const auto getNormal = [](uint32_t _ring, uint32_t _segment)
+			{
+				const float theta = Pi<float>() * float(_ring) / float(SphereRings);
+				const float phi = 2.0f * Pi<float>() * float(_segment) / float(2 * SphereRings);
+				return float3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			};
+			const auto addTriangle = [&](const float3& _n0, const float3& _n1, const float3& _n2)
+			{
+				_triangles.emplace_back(_center + _n0 * _radius, _center + _n1 * _radius, _center + _n2 * _radius,
+					float2(0.0f, 0.0f), float2(0.0f, 0.0f), float2(0.0f, 0.0f), _n0, _n1, _n2);
+			};
+
+			for (uint32_t ring = 0; ring < SphereRings; ring++)
+			{
+				for (uint32_t segment = 0; segment < 2 * SphereRings; segment++)
+				{
+					const float3 n00 = getNormal(ring, segment);
+					const float3 n01 = getNormal(ring, segment + 1);
+					const float3 n10 = getNormal(ring + 1, segment);
+					const float3 n11 = getNormal(ring + 1, segment + 1);
+					// The rings at the poles collapse to a point, only one of their triangles has an area
+					if (ring > 0)
+					{
+						addTriangle(n00, n01, n11);
+					}
+					if (ring + 1 < SphereRings)
+					{
+						addTriangle(n00, n11, n10);
+					}
+				}
+			}
+		}
+
+		// A grid of tessellated spheres on a plane, so the secondary rays run through a BVH instead of a handful
+		// of analytic shapes
+		void BuildSphereGrid(Scene* _scene, Material* _material)
+		{
+			std::vector<Triangle> triangles;
+			for (uint32_t z = 0; z < SphereGridSize; z++)
+			{
+				for (uint32_t x = 0; x < SphereGridSize; x++)
+				{
+					const float3 center(3.0f * (float(x) - 0.5f * float(SphereGridSize - 1)), -0.5f, -3.0f * float(z) - 1.0f);
+					AddSphereTriangles(triangles, center, 0.5f);
+				}
+			}
+			_scene->AddMesh(Mesh(std::move(triangles), _material));
+			_scene->AddShape(new Plane(float3(0.0f, -1.0f, 0.0f), float3(0.0f, 1.0f, 0.0f)), new Material(Color::White, 0.0f, nullptr));
+		}
+	}
+
+	void SceneLoading::BuildScene(Scene* _scene, const std::string& _scenePath)
+	{
+		if (_scenePath == BuiltinScene)
+		{
+			Material* diffuse = new Material(Color::White, 0.0f, nullptr);
+			Material* mirror = new Material(Color::Red, 0.5f, nullptr);
+			Material* glass = new Material(float3(0.8f, 0.9f, 1.0f), 0.0f, nullptr);
+			glass->type = Type::Dielectric;
+			glass->RefractionIndex = 1.5f;
+
+			_scene->AddShape(new Plane(float3(0.0f, -1.0f, 0.0f), float3(0.0f, 1.0f, 0.0f)), diffuse);
+			_scene->AddShape(new Sphere(float3(0.0f, 0.0f, -3.0f), 1.0f), mirror);
+			_scene->AddShape(new Sphere(float3(1.5f, 0.0f, -2.0f), 0.5f), glass);
+		}
+		else if (_scenePath == MirrorScene)
+		{
+			BuildSphereGrid(_scene, new Material(float3(0.9f, 0.9f, 0.9f), 0.9f, nullptr));
+		}
+		else if (_scenePath == GlassScene)
+		{
+			Material* glass = new Material(float3(0.8f, 0.9f, 1.0f), 0.0f, nullptr);
+			glass->type = Type::Dielectric;
+			glass->RefractionIndex = 1.5f;
+			BuildSphereGrid(_scene, glass);
+		}
+		else
+		{
+			Material* material = new Material(Color::White, 0.0f, nullptr);
+			ModelLoading::LoadModel(_scene, material, float3(0.0f, 0.0f, 0.0f), _scenePath);
+		}
+		_scene->AddDirectionalLight(DirectionalLight{ float3(0.0f, -0.75f, -0.75f).Normalize(), 0.6f, Color::White });
+	}
+
+	bool SceneLoading::IsBuiltin(const std::string& _scenePath)
+	{
+		return std::find(std::begin(BuiltinScenes), std::end(BuiltinScenes), _scenePath) != std::end(BuiltinScenes);
+	}
+}
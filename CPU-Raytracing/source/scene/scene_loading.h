@@ -0,0 +1,17 @@
+#pragma once
+#include "./raytracing/scene.h"
+
+#include <string>
+
+namespace CRT
+{
+	class SceneLoading
+	{
+	public:
+		// Fills the scene from a model file, or with a few spheres on a plane for "builtin". "builtin-mirrors" and
+		// "builtin-glass" are grids of mirror or glass spheres made of triangles, for benchmarking secondary rays
+		static void BuildScene(Scene* _scene, const std::string& _scenePath);
+		// Whether BuildScene generates the scene itself instead of loading it from a file
+		static bool IsBuiltin(const std::string& _scenePath);
+	};
+}